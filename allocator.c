@@ -1,116 +1,184 @@
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 
 #include "display.h"
 #include "allocator.h"
 
-typedef struct Object{
-    void* pointer;
-    struct Object* next;
-} Object;
-
-static Object *front = NULL, *rear = NULL;
-static int allocationCount = 0, insertCount = 0;
-
-static void insert(void *mem){
-    insertCount++;
-    if(front == NULL){
-//        printf("\n[Allocator] Front was nil. Rear was %p!", rear);
-        front = rear = (Object *)malloc(sizeof(Object));
-        front->pointer = mem;
-        front->next = NULL;
-    }
-    else{
-//        printf("\n[Allocator] Rear->next is at %p", rear->next);
-        rear->next = (Object *)malloc(sizeof(Object));
-        rear->next->pointer = mem;
-        rear->next->next = NULL;
-        rear = rear->next;
-    }
-//        printf("\n[Allocator] Created object at %p holding pointer %p!", rear, mem);
-//        fflush(stdout);
+// Small requests are served from slabs of equal sized slots, one free
+// list per size class. Larger ones go to malloc. Every block carries a
+// header naming its class, so memfree and reallocate need no search.
+
+#define SLAB_SIZE (64 * 1024)
+#define CLASS_LARGE CLASS_COUNT
+#define FREED 0xdeadu
+
+static const size_t classSizes[CLASS_COUNT] = {16, 32, 48, 64, 96, 128, 192, 256};
+
+// Class of each request size, in steps of 16 bytes
+static const unsigned char classOf[] = {0, 0, 1, 2, 3, 4, 4, 5, 5, 6, 6, 6, 6, 7, 7, 7, 7};
+
+typedef struct{
+    unsigned int sizeClass;
+    unsigned int state; // FREED once given back
+    size_t size;        // usable bytes
+} Header;
+
+typedef struct Slot{
+    Header header;
+    struct Slot *next; // while free
+} Slot;
+
+typedef struct Slab{
+    struct Slab *next;
+    size_t padding;
+} Slab;
+
+typedef struct Large{
+    struct Large *prev;
+    struct Large *next;
+    Header header;
+} Large;
+
+static Slot *freeLists[CLASS_COUNT] = {NULL};
+static Slab *slabs = NULL;
+static Large *larges = NULL;
+static size_t live[CLASS_COUNT + 1] = {0};
+
+static void outOfMemory(){
+    printf(error("Unable to allocate object! Insufficient memory!"));
+    exit(1);
 }
 
-static void exchange(void *oldmem, void *newmem){
-    Object *bak = front;
-    while(bak != NULL){
-        if(bak->pointer == oldmem){
-//            printf("\n[Allocator] Exchanged %p to %p", oldmem, newmem);
-//            fflush(stdout);
-            bak->pointer = newmem;
-            return;
-        }
-        bak = bak->next;
+static void refill(int sizeClass){
+    size_t stride = sizeof(Header) + classSizes[sizeClass];
+    Slab *slab = (Slab *)malloc(SLAB_SIZE);
+    char *p = (char *)(slab + 1), *end = (char *)slab + SLAB_SIZE;
+    if(slab == NULL)
+        outOfMemory();
+    slab->next = slabs;
+    slabs = slab;
+    while(p + stride <= end){
+        Slot *s = (Slot *)p;
+        s->header.sizeClass = sizeClass;
+        s->header.size = classSizes[sizeClass];
+        s->next = freeLists[sizeClass];
+        freeLists[sizeClass] = s;
+        p += stride;
     }
-    insert(newmem);
+}
+
+static void* allocateLarge(size_t size){
+    Large *l = (Large *)malloc(sizeof(Large) + size);
+    if(l == NULL)
+        outOfMemory();
+    l->prev = NULL;
+    l->next = larges;
+    if(larges != NULL)
+        larges->prev = l;
+    larges = l;
+    l->header.sizeClass = CLASS_LARGE;
+    l->header.state = 0;
+    l->header.size = size;
+    live[CLASS_LARGE] += size;
+    return l + 1;
 }
 
 void* mallocate(size_t size){
-    void *mem = malloc(size);
-    allocationCount++;
-    if(mem == NULL){
-        printf(error("Unable to allocate object! Insufficient memory!"));
-        exit(1);
+    if(size > classSizes[CLASS_COUNT - 1])
+        return allocateLarge(size);
+    int sizeClass = classOf[(size + 15) >> 4];
+    if(freeLists[sizeClass] == NULL)
+        refill(sizeClass);
+    Slot *s = freeLists[sizeClass];
+    freeLists[sizeClass] = s->next;
+    s->header.state = 0;
+    live[sizeClass] += classSizes[sizeClass];
+    return &s->next;
+}
+
+void memfree(void *mem){
+    if(mem == NULL)
+        return;
+    Header *h = (Header *)mem - 1;
+    if(h->state == FREED){
+        printf(error("[Allocator] Block %p is freed twice!"), mem);
+        return;
     }
-    insert(mem);
-    return mem;
+    h->state = FREED;
+    if(h->sizeClass == CLASS_LARGE){
+        Large *l = (Large *)mem - 1;
+        if(l->prev != NULL)
+            l->prev->next = l->next;
+        else
+            larges = l->next;
+        if(l->next != NULL)
+            l->next->prev = l->prev;
+        live[CLASS_LARGE] -= h->size;
+        free(l);
+        return;
+    }
+    Slot *s = (Slot *)h;
+    s->next = freeLists[h->sizeClass];
+    freeLists[h->sizeClass] = s;
+    live[h->sizeClass] -= h->size;
 }
 
 void* reallocate(void *mem, size_t size){
-    void *newmem = realloc(mem, size);
-    if(newmem == NULL){
-        printf(error("Unable to extend! Insufficient memory!"));
-        exit(1);
+    if(mem == NULL)
+        return mallocate(size);
+    Header *h = (Header *)mem - 1;
+    if(h->sizeClass != CLASS_LARGE && size <= h->size)
+        return mem;
+    if(h->sizeClass == CLASS_LARGE && size > classSizes[CLASS_COUNT - 1]){
+        Large *l = (Large *)mem - 1, *moved = (Large *)realloc(l, sizeof(Large) + size);
+        if(moved == NULL)
+            outOfMemory();
+        if(moved->prev != NULL)
+            moved->prev->next = moved;
+        else
+            larges = moved;
+        if(moved->next != NULL)
+            moved->next->prev = moved;
+        live[CLASS_LARGE] += size - moved->header.size;
+        moved->header.size = size;
+        return moved + 1;
     }
-    exchange(mem, newmem);
-//    printf("\n[Allocator] Reallocated %p to %p", mem, newmem);
-//        fflush(stdout);
+    void *newmem = mallocate(size);
+    memcpy(newmem, mem, h->size < size ? h->size : size);
+    memfree(mem);
     return newmem;
 }
 
-void memfree(void *old){
-    Object *bak = front, *prev = NULL;
-    while(bak != NULL){
-        if(bak->pointer == old){
-            if(prev == NULL){
-                if(rear == front)
-                    rear = front = NULL;
-                else
-                    front = front->next;
-            }
-            else{
-                prev->next = bak->next;
-                if(prev->next == NULL)
-                    rear = prev;
-            }
-            free(bak->pointer);
-            allocationCount--;
-            insertCount--;
-            free(bak);
-            return;
-        }
-        prev = bak;
-        bak = bak->next;
+void memfree_all(){
+    int i = 0;
+    while(slabs != NULL){
+        Slab *next = slabs->next;
+        free(slabs);
+        slabs = next;
     }
- /*   bak = front;
-    while(bak->next != NULL){
-        rear = bak;
-        bak = bak->next;
+    while(larges != NULL){
+        Large *next = larges->next;
+        free(larges);
+        larges = next;
+    }
+    while(i <= CLASS_COUNT){
+        if(i < CLASS_COUNT)
+            freeLists[i] = NULL;
+        live[i] = 0;
+        i++;
     }
-    */
 }
 
-void memfree_all(){
-//    printf("\n[Allocator] Allocated memory %d times in %d objects", allocationCount, insertCount);
+size_t memlive(int sizeClass){
+    return live[sizeClass];
+}
+
+void memstats(){
     int i = 0;
-    while(front != NULL){
-        Object *bak = front->next;
-//        printf("\n[Allocator] Freed object %p holding %p", front, front->pointer);
-        free(front->pointer);
-        free(front);
-        front = bak;
+    while(i < CLASS_COUNT){
+        printf("\n[Allocator] %4zu bytes : %zu live", classSizes[i], live[i]);
         i++;
     }
-//    printf("\n[Allocator] Freed %d objects!", insertCount);
-    front = rear = NULL;
+    printf("\n[Allocator] large : %zu live", live[CLASS_LARGE]);
 }
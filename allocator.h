@@ -3,15 +3,17 @@
 
 #include <stdlib.h>
 
-/*
+// Size classes of the slab allocator, requests above the last are
+// passed on to malloc
+#define CLASS_COUNT 8
+
 void* mallocate(size_t size);
 void* reallocate(void *oldmem, size_t size);
 void memfree(void *mem);
 void memfree_all();
-*/
-#define mallocate(x) malloc(x)
-#define reallocate(x,y) realloc(x, y)
-#define memfree(x) free(x)
-#define memfree_all() {}
+
+// Bytes held by live blocks of a size class, CLASS_COUNT for the large ones
+size_t memlive(int sizeClass);
+void memstats();
 
 #endif
@@ -0,0 +1,67 @@
+#include <string.h>
+
+#include "allocator.h"
+#include "arena.h"
+
+#define ARENA_BLOCK_SIZE (64 * 1024)
+#define ARENA_ALIGN 8
+
+struct ArenaBlock{
+    ArenaBlock *next;
+    size_t used;
+    size_t size;
+    char data[];
+};
+
+static size_t align(size_t size){
+    return (size + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+}
+
+static ArenaBlock* newBlock(size_t size, ArenaBlock *next){
+    ArenaBlock *b = (ArenaBlock *)mallocate(sizeof(ArenaBlock) + size);
+    b->next = next;
+    b->used = 0;
+    b->size = size;
+    return b;
+}
+
+void* arena_alloc(Arena *arena, size_t size){
+    ArenaBlock *b = arena->blocks;
+    size = align(size);
+    if(b == NULL || b->size - b->used < size){
+        // Large requests get a block of their own behind the current
+        // one, which keeps filling up
+        if(size > ARENA_BLOCK_SIZE / 4 && b != NULL){
+            b->next = newBlock(size, b->next);
+            b->next->used = size;
+            return b->next->data;
+        }
+        b = arena->blocks = newBlock(size > ARENA_BLOCK_SIZE ? size : ARENA_BLOCK_SIZE, b);
+    }
+    void *mem = b->data + b->used;
+    b->used += size;
+    return mem;
+}
+
+void* arena_resize(Arena *arena, void *old, size_t oldSize, size_t size){
+    ArenaBlock *b = arena->blocks;
+    if(old != NULL && b != NULL && (char *)old + align(oldSize) == b->data + b->used
+            && (char *)old + align(size) <= b->data + b->size){
+        b->used = (char *)old - b->data + align(size);
+        return old;
+    }
+    void *mem = arena_alloc(arena, size);
+    if(old != NULL)
+        memcpy(mem, old, oldSize < size ? oldSize : size);
+    return mem;
+}
+
+void arena_free(Arena *arena){
+    ArenaBlock *b = arena->blocks;
+    while(b != NULL){
+        ArenaBlock *next = b->next;
+        memfree(b);
+        b = next;
+    }
+    arena->blocks = NULL;
+}
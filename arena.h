@@ -0,0 +1,19 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+
+// Region allocator : memory is handed out by bumping through large
+// blocks and is given back all at once by arena_free
+typedef struct ArenaBlock ArenaBlock;
+
+typedef struct{
+    ArenaBlock *blocks;
+} Arena;
+
+void* arena_alloc(Arena *arena, size_t size);
+// Extends the latest allocation in place when it has room, else copies
+void* arena_resize(Arena *arena, void *old, size_t oldSize, size_t size);
+void arena_free(Arena *arena);
+
+#endif
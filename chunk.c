@@ -0,0 +1,91 @@
+#include "allocator.h"
+#include "chunk.h"
+
+Chunk* chunk_new(){
+    Chunk *chunk = (Chunk *)mallocate(sizeof(Chunk));
+    chunk->count = chunk->capacity = 0;
+    chunk->code = NULL;
+    chunk->lines = NULL;
+    chunk->constantCount = 0;
+    chunk->constants = NULL;
+    chunk->nameCount = 0;
+    chunk->names = NULL;
+    chunk->localCount = 0;
+    chunk->locals = NULL;
+    chunk->cacheCount = 0;
+    chunk->caches = NULL;
+    chunk->calleeCount = 0;
+    chunk->callees = NULL;
+    return chunk;
+}
+
+void chunk_free(Chunk *chunk){
+    int i = 0;
+    while(i < chunk->constantCount){
+        Object o = chunk->constants[i];
+        if(o.type == OBJECT_ROUTINE && o.routine->chunk != NULL)
+            chunk_free(o.routine->chunk);
+        else if(o.type == OBJECT_CONTAINER && o.container->chunk != NULL)
+            chunk_free(o.container->chunk);
+        i++;
+    }
+    memfree(chunk->code);
+    memfree(chunk->lines);
+    memfree(chunk->constants);
+    memfree(chunk->names);
+    memfree(chunk->caches);
+    memfree(chunk->callees);
+    memfree(chunk);
+}
+
+void chunk_write(Chunk *chunk, unsigned char byte, int line){
+    if(chunk->count == chunk->capacity){
+        chunk->capacity = chunk->capacity < 8 ? 8 : chunk->capacity * 2;
+        chunk->code = (unsigned char *)reallocate(chunk->code, sizeof(unsigned char) * chunk->capacity);
+        chunk->lines = (int *)reallocate(chunk->lines, sizeof(int) * chunk->capacity);
+    }
+    chunk->code[chunk->count] = byte;
+    chunk->lines[chunk->count] = line;
+    chunk->count++;
+}
+
+int chunk_add_constant(Chunk *chunk, Object value){
+    chunk->constantCount++;
+    chunk->constants = (Object *)reallocate(chunk->constants, sizeof(Object) * chunk->constantCount);
+    chunk->constants[chunk->constantCount - 1] = value;
+    return chunk->constantCount - 1;
+}
+
+int chunk_add_name(Chunk *chunk, char *name){
+    int i = 0;
+    while(i < chunk->nameCount){
+        if(chunk->names[i] == name)
+            return i;
+        i++;
+    }
+    chunk->nameCount++;
+    chunk->names = (char **)reallocate(chunk->names, sizeof(char *) * chunk->nameCount);
+    chunk->names[chunk->nameCount - 1] = name;
+    return chunk->nameCount - 1;
+}
+
+int chunk_add_cache(Chunk *chunk){
+    chunk->cacheCount++;
+    chunk->caches = (MemberCache *)reallocate(chunk->caches, sizeof(MemberCache) * chunk->cacheCount);
+    chunk->caches[chunk->cacheCount - 1].container = NULL;
+    chunk->caches[chunk->cacheCount - 1].slot = 0;
+    return chunk->cacheCount - 1;
+}
+
+int chunk_add_callee(Chunk *chunk, void *callee){
+    int i = 0;
+    while(i < chunk->calleeCount){
+        if(chunk->callees[i] == callee)
+            return i;
+        i++;
+    }
+    chunk->calleeCount++;
+    chunk->callees = (void **)reallocate(chunk->callees, sizeof(void *) * chunk->calleeCount);
+    chunk->callees[chunk->calleeCount - 1] = callee;
+    return chunk->calleeCount - 1;
+}
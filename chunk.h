@@ -0,0 +1,87 @@
+#ifndef CHUNK_H
+#define CHUNK_H
+
+#include "interpreter.h"
+
+// Operands are big endian 16 bit constant/name indices or jump offsets unless noted
+typedef enum{
+    OP_CONSTANT,        // [index]                  -> value
+    OP_NULL,            //                          -> Null
+    OP_POP,             // value                    ->
+    OP_GET_VAR,         // [name]                   -> value
+    OP_SET_VAR,         // [name] value             ->
+    OP_GET_INDEX,       // [name] index             -> value
+    OP_SET_INDEX,       // [name] index value       ->
+    OP_GET_MEMBER,      // [name][cache] instance   -> value
+    OP_SET_MEMBER,      // [name][cache] instance value ->
+    OP_SET_MEMBER_INDEX,// [name][cache] instance index value ->
+    OP_GET_LOCAL,       // [slot:8]                 -> value
+    OP_SET_LOCAL,       // [slot:8] value           ->
+    OP_GET_LOCAL_INDEX, // [slot:8] index           -> value
+    OP_SET_LOCAL_INDEX, // [slot:8] index value     ->
+    OP_GET_LOCAL_ELEMENT,// [slot:8] index          -> value, the index checked by OP_CHECK_BOUNDS
+    OP_SET_LOCAL_ELEMENT,// [slot:8] index value    ->
+    OP_APPEND_VAR,      // [name] value             -> (variable = variable + value)
+    OP_APPEND_LOCAL,    // [slot:8] value           ->
+    OP_ENTER,           // instance                 -> (scope switched to instance)
+    OP_LEAVE,           //                          -> (scope restored)
+    OP_ADD,
+    OP_SUBTRACT,
+    OP_MULTIPLY,
+    OP_DIVIDE,
+    OP_POWER,
+    OP_MODULO,
+    OP_GREATER,
+    OP_GREATER_EQUAL,
+    OP_LESS,
+    OP_LESS_EQUAL,
+    OP_EQUAL,
+    OP_NOT_EQUAL,
+    OP_AND,
+    OP_OR,
+    OP_JUMP,            // [offset]
+    OP_JUMP_IF_FALSE,   // [offset] condition       ->
+    OP_LOOP,            // [offset]
+    OP_CHECK_BOUNDS,    // [count:8]{[slot:8][low][high]}[offset] counter bound -> (jumps unless all in range)
+    OP_CALL,            // [name][argc:8] args...   -> result
+    OP_CALL_ROUTINE,    // [callee][argc:8] args... -> result, linked calls
+    OP_CALL_CONTAINER,  // [callee][argc:8] args... -> instance
+    OP_CALL_FOREIGN,    // [callee][argc:8] args... -> result
+    OP_DISCARD,         // result                   ->
+    OP_RETURN,          // value                    ->
+    OP_PRINT,           // value                    ->
+    OP_INPUT,           // [name][datatype:8]
+    OP_LOCAL_INPUT,     // [slot:8][datatype:8]
+    OP_ARRAY,           // [name][datatype:8] dim   ->
+    OP_LOCAL_ARRAY,     // [slot:8][datatype:8] dim ->
+    OP_DEFINE,          // [index]
+    OP_END
+} OpCode;
+
+typedef struct Chunk{
+    int count;
+    int capacity;
+    unsigned char *code;
+    int *lines;
+    int constantCount;
+    Object *constants;
+    int nameCount;
+    char **names;
+    int localCount;
+    char **locals;
+    int cacheCount;
+    MemberCache *caches; // one per member access site
+    int calleeCount;
+    void **callees; // Routine or Container bound by the linker
+} Chunk;
+
+Chunk* chunk_new();
+void chunk_free(Chunk *chunk);
+
+void chunk_write(Chunk *chunk, unsigned char byte, int line);
+int chunk_add_constant(Chunk *chunk, Object value);
+int chunk_add_name(Chunk *chunk, char *name);
+int chunk_add_cache(Chunk *chunk);
+int chunk_add_callee(Chunk *chunk, void *callee);
+
+#endif
@@ -0,0 +1,540 @@
+#include <stdio.h>
+
+#include "display.h"
+#include "allocator.h"
+#include "compiler.h"
+
+typedef struct Loop{
+    struct Loop *parent;
+    int breakCount;
+    int *breaks;
+} Loop;
+
+static Chunk *current = NULL;
+static Loop *loop = NULL;
+static int unchecked = 0; // within the guarded copy of a loop
+static int ce = 0;
+
+static void compileExpression(Expression *expr);
+static void compileBlock(Block b);
+
+static void emitByte(unsigned char byte, int line){
+    chunk_write(current, byte, line);
+}
+
+static void emitShort(int value, int line){
+    if(value > 0xffff){
+        printf(line_error("Too many constants or names in one routine!"), line);
+        ce++;
+    }
+    emitByte((value >> 8) & 0xff, line);
+    emitByte(value & 0xff, line);
+}
+
+static void emitOp(OpCode op, int line){
+    emitByte(op, line);
+}
+
+static void emitName(OpCode op, char *name, int line){
+    emitOp(op, line);
+    emitShort(chunk_add_name(current, name), line);
+}
+
+static void emitMember(OpCode op, char *name, int line){
+    emitName(op, name, line);
+    emitShort(chunk_add_cache(current), line);
+}
+
+static void emitSlot(OpCode op, int slot, int line){
+    emitOp(op, line);
+    emitByte(slot, line);
+}
+
+static void emitConstant(Object o, int line){
+    emitOp(OP_CONSTANT, line);
+    emitShort(chunk_add_constant(current, o), line);
+}
+
+static int emitJump(OpCode op, int line){
+    emitOp(op, line);
+    emitByte(0xff, line);
+    emitByte(0xff, line);
+    return current->count - 2;
+}
+
+static void patchJump(int offset){
+    int jump = current->count - offset - 2;
+    if(jump > 0xffff){
+        printf(line_error("Too much code to jump over!"), current->lines[offset]);
+        ce++;
+    }
+    current->code[offset] = (jump >> 8) & 0xff;
+    current->code[offset + 1] = jump & 0xff;
+}
+
+static void emitLoop(int start, int line){
+    emitOp(OP_LOOP, line);
+    int offset = current->count - start + 2;
+    if(offset > 0xffff){
+        printf(line_error("Loop body too large!"), line);
+        ce++;
+    }
+    emitByte((offset >> 8) & 0xff, line);
+    emitByte(offset & 0xff, line);
+}
+
+static OpCode binaryOpCode(TokenType type){
+    switch(type){
+        case TOKEN_PLUS:
+            return OP_ADD;
+        case TOKEN_MINUS:
+            return OP_SUBTRACT;
+        case TOKEN_STAR:
+            return OP_MULTIPLY;
+        case TOKEN_SLASH:
+            return OP_DIVIDE;
+        case TOKEN_CARET:
+            return OP_POWER;
+        case TOKEN_PERCEN:
+            return OP_MODULO;
+        case TOKEN_GREATER:
+            return OP_GREATER;
+        case TOKEN_GREATER_EQUAL:
+            return OP_GREATER_EQUAL;
+        case TOKEN_LESS:
+            return OP_LESS;
+        case TOKEN_LESS_EQUAL:
+            return OP_LESS_EQUAL;
+        case TOKEN_EQUAL_EQUAL:
+            return OP_EQUAL;
+        case TOKEN_BANG_EQUAL:
+            return OP_NOT_EQUAL;
+        case TOKEN_AND:
+            return OP_AND;
+        case TOKEN_OR:
+            return OP_OR;
+        default:
+            return OP_NULL;
+    }
+}
+
+static void compileCall(Call c){
+    int i = 0;
+    if(c.argCount > 0xff){
+        printf(line_error("Too many arguments in call to %s!"), c.line, c.identifer);
+        ce++;
+    }
+    while(i < c.argCount){
+        compileExpression(c.arguments[i]);
+        i++;
+    }
+    switch(c.type){
+        case CALL_ROUTINE:
+            emitOp(OP_CALL_ROUTINE, c.line);
+            emitShort(chunk_add_callee(current, c.routine), c.line);
+            break;
+        case CALL_CONTAINER:
+            emitOp(OP_CALL_CONTAINER, c.line);
+            emitShort(chunk_add_callee(current, c.container), c.line);
+            break;
+        case CALL_FOREIGN:
+            emitOp(OP_CALL_FOREIGN, c.line);
+            emitShort(chunk_add_callee(current, c.routine), c.line);
+            break;
+        default:
+            emitName(OP_CALL, c.identifer, c.line);
+            break;
+    }
+    emitByte(c.argCount, c.line);
+}
+
+// Evaluates member in the scope of the instance on top of the stack
+static void compileMember(Expression *member, int line){
+    if(member->type == EXPR_VARIABLE)
+        emitMember(OP_GET_MEMBER, member->variable.name, line);
+    else if(member->type == EXPR_REFERENCE
+            && member->referenceExpression.containerName->type == EXPR_VARIABLE){
+        emitMember(OP_GET_MEMBER, member->referenceExpression.containerName->variable.name, line);
+        compileMember(member->referenceExpression.member, line);
+    }
+    else{
+        emitOp(OP_ENTER, line);
+        compileExpression(member);
+        emitOp(OP_LEAVE, line);
+    }
+}
+
+static void compileExpression(Expression *expr){
+    switch(expr->type){
+        case EXPR_LITERAL:
+            {
+                Object o = {.literal = expr->literal, .type = OBJECT_LITERAL};
+                emitConstant(o, expr->line);
+            }
+            break;
+        case EXPR_BINARY:
+            compileExpression(expr->binary.left);
+            compileExpression(expr->binary.right);
+            emitOp(binaryOpCode(expr->binary.op.type), expr->binary.line);
+            break;
+        case EXPR_LOGICAL:
+            compileExpression(expr->logical.left);
+            compileExpression(expr->logical.right);
+            emitOp(binaryOpCode(expr->logical.op.type), expr->logical.line);
+            break;
+        case EXPR_VARIABLE:
+            if(expr->variable.slot >= 0)
+                emitSlot(OP_GET_LOCAL, expr->variable.slot, expr->variable.line);
+            else
+                emitName(OP_GET_VAR, expr->variable.name, expr->variable.line);
+            break;
+        case EXPR_ARRAY:
+            compileExpression(expr->arrayExpression.index);
+            if(expr->arrayExpression.slot >= 0)
+                emitSlot(unchecked && expr->arrayExpression.unchecked ? OP_GET_LOCAL_ELEMENT : OP_GET_LOCAL_INDEX,
+                        expr->arrayExpression.slot, expr->arrayExpression.line);
+            else
+                emitName(OP_GET_INDEX, expr->arrayExpression.identifier, expr->arrayExpression.line);
+            break;
+        case EXPR_CALL:
+            compileCall(expr->callExpression);
+            break;
+        case EXPR_REFERENCE:
+            compileExpression(expr->referenceExpression.containerName);
+            compileMember(expr->referenceExpression.member, expr->referenceExpression.line);
+            break;
+        case EXPR_NONE:
+            emitOp(OP_NULL, 0);
+            break;
+    }
+}
+
+// Leaves the instance which owns the assignment target on the stack,
+// then evaluates the target index (if any) and the value
+static void compileWriteRef(Expression *id, Expression *init, int nested, int line){
+    Expression *container = id->referenceExpression.containerName;
+    Expression *mem = id->referenceExpression.member;
+    if(!nested)
+        compileExpression(container);
+    else if(container->type == EXPR_VARIABLE)
+        emitMember(OP_GET_MEMBER, container->variable.name, line);
+    else{
+        emitOp(OP_ENTER, line);
+        compileExpression(container);
+        emitOp(OP_LEAVE, line);
+    }
+
+    if(mem->type == EXPR_ARRAY){
+        compileExpression(mem->arrayExpression.index);
+        compileExpression(init);
+        emitMember(OP_SET_MEMBER_INDEX, mem->arrayExpression.identifier, line);
+    }
+    else if(mem->type == EXPR_VARIABLE){
+        compileExpression(init);
+        emitMember(OP_SET_MEMBER, mem->variable.name, line);
+    }
+    else if(mem->type == EXPR_REFERENCE)
+        compileWriteRef(mem, init, 1, line);
+    else{
+        printf(line_error("Bad member access in assignment!"), line);
+        ce++;
+    }
+}
+
+// Set s = s + a + b marked by the optimizer : a, then b, is appended to s
+static void compileAppend(Expression *expr, Variable *target){
+    if(expr->type != EXPR_BINARY)
+        return;
+    compileAppend(expr->binary.left, target);
+    compileExpression(expr->binary.right);
+    if(target->slot >= 0)
+        emitSlot(OP_APPEND_LOCAL, target->slot, expr->line);
+    else
+        emitName(OP_APPEND_VAR, target->name, expr->line);
+}
+
+static void compileSet(Set s){
+    int i = 0;
+    while(i < s.count){
+        Expression *id = s.initializers[i].identifer;
+        Expression *init = s.initializers[i].initializerExpression;
+        if(s.initializers[i].append)
+            compileAppend(init, &id->variable);
+        else if(id->type == EXPR_VARIABLE){
+            compileExpression(init);
+            if(id->variable.slot >= 0)
+                emitSlot(OP_SET_LOCAL, id->variable.slot, s.line);
+            else
+                emitName(OP_SET_VAR, id->variable.name, s.line);
+        }
+        else if(id->type == EXPR_ARRAY){
+            compileExpression(id->arrayExpression.index);
+            compileExpression(init);
+            if(id->arrayExpression.slot >= 0)
+                emitSlot(unchecked && id->arrayExpression.unchecked ? OP_SET_LOCAL_ELEMENT : OP_SET_LOCAL_INDEX,
+                        id->arrayExpression.slot, s.line);
+            else
+                emitName(OP_SET_INDEX, id->arrayExpression.identifier, s.line);
+        }
+        else if(id->type == EXPR_REFERENCE)
+            compileWriteRef(id, init, 0, s.line);
+        else{
+            printf(line_error("Bad assignment target!"), s.line);
+            ce++;
+        }
+        i++;
+    }
+}
+
+static void compileArray(ArrayInit ai){
+    int i = 0;
+    while(i < ai.count){
+        Expression *iden = ai.initializers[i];
+        compileExpression(iden->arrayExpression.index);
+        if(iden->arrayExpression.slot >= 0)
+            emitSlot(OP_LOCAL_ARRAY, iden->arrayExpression.slot, ai.line);
+        else
+            emitName(OP_ARRAY, iden->arrayExpression.identifier, ai.line);
+        emitByte(ai.datatypes[i], ai.line);
+        i++;
+    }
+}
+
+static void compileInput(InputStatement is){
+    int i = 0;
+    while(i < is.count){
+        Input in = is.inputs[i];
+        if(in.type == INPUT_PROMPT){
+            Literal l = {.type = LIT_STRING};
+            l.sVal = in.prompt;
+            Object o = {.literal = l, .type = OBJECT_LITERAL};
+            emitConstant(o, is.line);
+            emitOp(OP_PRINT, is.line);
+        }
+        else{
+            if(in.slot >= 0)
+                emitSlot(OP_LOCAL_INPUT, in.slot, is.line);
+            else
+                emitName(OP_INPUT, in.identifer, is.line);
+            emitByte(in.datatype, is.line);
+        }
+        i++;
+    }
+}
+
+static void compilePrint(Print p){
+    int i = 0;
+    while(i < p.argCount){
+        compileExpression(p.expressions[i]);
+        emitOp(OP_PRINT, p.line);
+        i++;
+    }
+}
+
+static void compileIf(If ifs){
+    compileExpression(ifs.condition);
+    int elseJump = emitJump(OP_JUMP_IF_FALSE, ifs.line);
+    compileBlock(ifs.thenBranch);
+    if(ifs.elseBranch.numStatements > 0){
+        int endJump = emitJump(OP_JUMP, ifs.line);
+        patchJump(elseJump);
+        compileBlock(ifs.elseBranch);
+        patchJump(endJump);
+    }
+    else
+        patchJump(elseJump);
+}
+
+static void compileLoop(While w){
+    Loop l = {loop, 0, NULL};
+    loop = &l;
+    int start = current->count;
+    compileExpression(w.condition);
+    int exitJump = emitJump(OP_JUMP_IF_FALSE, w.line);
+    compileBlock(w.body);
+    emitLoop(start, w.line);
+    patchJump(exitJump);
+    int i = 0;
+    while(i < l.breakCount){
+        patchJump(l.breaks[i]);
+        i++;
+    }
+    memfree(l.breaks);
+    loop = l.parent;
+}
+
+// Returns the offset to patch to the checked copy of the loop
+static int emitGuard(BoundsGuard *g, int line){
+    int i = 0;
+    compileExpression(g->counter);
+    compileExpression(g->bound);
+    emitOp(OP_CHECK_BOUNDS, line);
+    emitByte(g->count, line);
+    while(i < g->count){
+        emitByte(g->arrays[i].slot, line);
+        emitShort(g->arrays[i].low & 0xffff, line);
+        emitShort(g->arrays[i].high & 0xffff, line);
+        i++;
+    }
+    emitByte(0xff, line);
+    emitByte(0xff, line);
+    return current->count - 2;
+}
+
+// A guarded loop is emitted twice, with its marked accesses unchecked
+// and as is in case the guard fails
+static void compileWhile(While w){
+    if(w.guard == NULL){
+        compileLoop(w);
+        return;
+    }
+    int checked = emitGuard(w.guard, w.line);
+    unchecked = 1;
+    compileLoop(w);
+    unchecked = 0;
+    int end = emitJump(OP_JUMP, w.line);
+    patchJump(checked);
+    compileLoop(w);
+    patchJump(end);
+}
+
+static void compileBreak(Break b){
+    if(loop == NULL){
+        printf(line_error("Break without While!"), b.pos.line);
+        ce++;
+        return;
+    }
+    loop->breakCount++;
+    loop->breaks = (int *)reallocate(loop->breaks, sizeof(int) * loop->breakCount);
+    loop->breaks[loop->breakCount - 1] = emitJump(OP_JUMP, b.pos.line);
+}
+
+static void compileCallStatement(CallStatement cs){
+    if(cs.callee->type != EXPR_CALL){
+        printf(line_error("Expected call expression!"), cs.line);
+        ce++;
+        return;
+    }
+    compileCall(cs.callee->callExpression);
+    emitOp(OP_DISCARD, cs.line);
+}
+
+static void compileReturn(ReturnStatement rs){
+    if(rs.value != NULL)
+        compileExpression(rs.value);
+    else
+        emitOp(OP_NULL, rs.line);
+    emitOp(OP_RETURN, rs.line);
+}
+
+static Chunk* compileBody(Block b, int line){
+    Chunk *enclosing = current;
+    Loop *enclosingLoop = loop;
+    current = chunk_new();
+    loop = NULL;
+    compileBlock(b);
+    emitOp(OP_NULL, line);
+    emitOp(OP_RETURN, line);
+    Chunk *body = current;
+    current = enclosing;
+    loop = enclosingLoop;
+    return body;
+}
+
+static void compileRoutine(Routine *r){
+    if(r->isNative == 0){
+        if(r->localCount > 0x100){
+            printf(line_error("Too many local variables in routine %s!"), r->line, r->name);
+            ce++;
+        }
+        r->chunk = compileBody(r->code, r->line);
+        r->chunk->localCount = r->localCount;
+        r->chunk->locals = r->locals;
+    }
+    Object o;
+    o.type = OBJECT_ROUTINE;
+    o.routine = r;
+    emitOp(OP_DEFINE, r->line);
+    emitShort(chunk_add_constant(current, o), r->line);
+}
+
+static void compileContainer(Container *c){
+    c->chunk = compileBody(c->constructor, c->line);
+    Object o;
+    o.type = OBJECT_CONTAINER;
+    o.container = c;
+    emitOp(OP_DEFINE, c->line);
+    emitShort(chunk_add_constant(current, o), c->line);
+}
+
+static void compileStatement(Statement *s){
+    switch(s->type){
+        case STATEMENT_PRINT:
+            compilePrint(s->printStatement);
+            break;
+        case STATEMENT_IF:
+            compileIf(s->ifStatement);
+            break;
+        case STATEMENT_WHILE:
+            compileWhile(s->whileStatement);
+            break;
+        case STATEMENT_SET:
+            compileSet(s->setStatement);
+            break;
+        case STATEMENT_ARRAY:
+            compileArray(s->arrayStatement);
+            break;
+        case STATEMENT_INPUT:
+            compileInput(s->inputStatement);
+            break;
+        case STATEMENT_BREAK:
+            compileBreak(s->breakStatement);
+            break;
+        case STATEMENT_END:
+            emitOp(OP_END, 0);
+            break;
+        case STATEMENT_ROUTINE:
+            compileRoutine(&s->routine);
+            break;
+        case STATEMENT_CONTAINER:
+            compileContainer(&s->container);
+            break;
+        case STATEMENT_CALL:
+            compileCallStatement(s->callStatement);
+            break;
+        case STATEMENT_RETURN:
+            compileReturn(s->returnStatement);
+            break;
+        case STATEMENT_BEGIN:
+        case STATEMENT_NOOP:
+        default:
+            break;
+    }
+}
+
+static void compileBlock(Block b){
+    int i = 0;
+    while(i < b.numStatements){
+        compileStatement(&b.statements[i]);
+        i++;
+    }
+}
+
+Chunk* compile(Code c){
+    int i = 0;
+    current = chunk_new();
+    loop = NULL;
+    while(i < c.count){
+        compileStatement(&c.parts[i]);
+        i++;
+    }
+    emitOp(OP_NULL, 0);
+    emitOp(OP_RETURN, 0);
+    Chunk *script = current;
+    current = NULL;
+    return script;
+}
+
+int hasCompileError(){
+    return ce;
+}
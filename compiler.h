@@ -0,0 +1,10 @@
+#ifndef COMPILER_H
+#define COMPILER_H
+
+#include "stmt.h"
+#include "chunk.h"
+
+Chunk* compile(Code c);
+int hasCompileError();
+
+#endif
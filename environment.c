@@ -1,113 +1,190 @@
 #include <string.h>
 #include <stdio.h>
-#include <string.h>
 
 #include "expr.h"
 #include "display.h"
 #include "allocator.h"
 #include "environment.h"
 #include "interpreter.h"
+#include "gc.h"
+#include "str.h"
 
-static void insert(Record *toInsert, Environment *parent){ 
-    if(parent->front == NULL){
-        parent->front = parent->rear = toInsert;
-    }
-    else{
-        parent->rear->next = toInsert;
-        parent->rear = toInsert;
-    }
+#define ENV_LINEAR_MAX 8
+#define FRAMES_MAX 16384
+
+// Environments of routine calls, taken and returned in stack order
+static Environment frames[FRAMES_MAX];
+static int frameCount = 0;
+
+static unsigned int hashSymbol(const char *symbol){
+    unsigned long x = (unsigned long)symbol;
+    x ^= x >> 16;
+    x *= 0x45d9f3b;
+    x ^= x >> 16;
+    return (unsigned int)x;
 }
 
-static void incr_ref(Object value){ 
-    if(value.type == OBJECT_INSTANCE){
-        if(value.instance->fromReturn == 1){
-            value.instance->fromReturn = 0;
-        }
-        value.instance->refCount++;
-        //        printf(debug("[New rec] Incremented refcount to %d of container %s#%d for identifer %s!"),
-        //                value.instance->refCount, value.instance->name, value.instance->insCount, identifer);
+static void tableInsert(Environment *env, int index){
+    int mask = env->tableSize - 1;
+    int i = hashSymbol(env->records[index].name) & mask;
+    while(env->table[i] != 0)
+        i = (i + 1) & mask;
+    env->table[i] = index + 1;
+}
+
+static void rehash(Environment *env){
+    int i = 0;
+    env->tableSize = env->tableSize == 0 ? 32 : env->tableSize * 2;
+    memfree(env->table);
+    env->table = (int *)mallocate(sizeof(int) * env->tableSize);
+    memset(env->table, 0, sizeof(int) * env->tableSize);
+    while(i < env->count){
+        tableInsert(env, i);
+        i++;
     }
 }
 
-static void rec_new(char* identifer, Object value, Environment *parent){
-    Record *env = (Record *)mallocate(sizeof(Record));
-    env->name = identifer;
-    incr_ref(value);
-    env->object = value;
-    env->next = NULL;
-    insert(env, parent);
+// Strings stored in a second place are copied before a write instead of
+// being changed in place (see writeIndex)
+static inline void share(Object value){
+    if(value.type == OBJECT_LITERAL && value.literal.type == LIT_STRING)
+        str_header(value.literal.sVal)->shared = 1;
 }
 
-void inline gc_obj(Object o){
-    if(o.type == OBJECT_INSTANCE){
-        Instance *ins = o.instance;
-        ins->refCount--;
-        if(ins->refCount <= 0 && ins->fromReturn == 0){
-            //            printf(debug("[Gc_Obj] Garbage collecting %s#%d!"), ins->name, ins->insCount);
-            env_free((Environment *)ins->environment);
-            memfree(ins);
-        }
+static void insert(char *identifer, Object value, Environment *parent){
+    share(value);
+    if(parent->count == parent->capacity){
+        parent->capacity = parent->capacity == 0 ? 2 : parent->capacity * 2;
+        parent->records = (Record *)reallocate(parent->records, sizeof(Record) * parent->capacity);
+    }
+    parent->records[parent->count].name = identifer;
+    parent->records[parent->count].object = value;
+    parent->count++;
+    if(parent->count > ENV_LINEAR_MAX){
+        if(parent->count * 2 > parent->tableSize)
+            rehash(parent);
+        else
+            tableInsert(parent, parent->count - 1);
     }
 }
 
-static void inline gc_rec(Record *rec){
-    gc_obj(rec->object);
+static Record* find(char *symbol, Environment *env){
+    if(env->table == NULL){
+        int i = 0;
+        while(i < env->count){
+            if(env->records[i].name == symbol)
+                return &env->records[i];
+            i++;
+        }
+        return NULL;
+    }
+    int mask = env->tableSize - 1, i = hashSymbol(symbol) & mask;
+    while(env->table[i] != 0){
+        Record *rec = &env->records[env->table[i] - 1];
+        if(rec->name == symbol)
+            return rec;
+        i = (i + 1) & mask;
+    }
+    return NULL;
 }
 
 static Record* env_match(char* identifer, Environment *env){
-    if(env == NULL)
-        return NULL;
-    Record *bak = env->front;
-    while(bak != NULL){
-        if(strcmp(bak->name, identifer) == 0)
-            return bak;
-        bak = bak->next;
+    while(env != NULL){
+        Record *rec = find(identifer, env);
+        if(rec != NULL)
+            return rec;
+        env = env->parent;
     }
-    return env_match(identifer, env->parent);
+    return NULL;
 }
 
 Environment* env_new(Environment *parent){
     Environment *ret = (Environment *)mallocate(sizeof(Environment));
-    ret->front = ret->rear = NULL;
+    ret->count = ret->capacity = ret->tableSize = 0;
+    ret->records = NULL;
+    ret->table = NULL;
     ret->parent = parent;
     return ret;
 }
 
 void env_free(Environment *env){
-    while(env->front != NULL){
-        Record *rec = env->front;
-        Record *bak = rec->next;
-        if(rec->object.type == OBJECT_ARRAY)
-            memfree(rec->object.arr.values);
-        else if(rec->object.type == OBJECT_INSTANCE){
-            gc_rec(rec);
-        }
-        //        memfree(rec->name);
-        memfree(rec);
-        env->front = bak;
-    }
+    memfree(env->records);
+    memfree(env->table);
     memfree(env);
 }
 
+void env_mark_frames(){
+    int i = 0;
+    while(i < frameCount){
+        gc_mark_env(&frames[i]);
+        i++;
+    }
+}
+
+Environment* env_push(Environment *parent, char *name, int line){
+    if(frameCount == FRAMES_MAX){
+        printf(runtime_error("Stack overflow while calling %s!"), line, name);
+        stop();
+    }
+    Environment *env = &frames[frameCount++];
+    env->parent = parent;
+    return env;
+}
+
+// The records array stays with the frame for the next call. The index
+// table is dropped, it is only rebuilt once the frame outgrows a scan.
+void env_pop(Environment *env){
+    env->count = 0;
+    if(env->table != NULL){
+        memfree(env->table);
+        env->table = NULL;
+        env->tableSize = 0;
+    }
+    frameCount--;
+}
+
+void slot_put(Object *slot, char *identifer, int line, Object value){
+    if(slot->type == OBJECT_ARRAY){
+        printf(runtime_error("Array %s cannot be assigned directly!"), line, identifer);
+        stop();
+    }
+    share(value);
+    *slot = value;
+}
+
+Object slot_get(Object *slot, char *identifer, int line){
+    if(slot->type == OBJECT_UNDEFINED){
+        printf(runtime_error("Undefined variable %s!"), line, identifer);
+        stop();
+    }
+    return *slot;
+}
+
 void env_put(char* identifer, int line, Object value, Environment *env){
     Record *get = env_match(identifer, env);
     if(get == NULL)
-        rec_new(identifer, value, env);
-    else if(get->object.type == OBJECT_ARRAY){
-        printf(runtime_error("Array cannot be assigned directly!"), line);
-        stop();
-    }
-    else{
-        Object old = get->object;
-        incr_ref(value);
-        get->object = value;
-        if(old.type == OBJECT_INSTANCE){
-            gc_obj(old);
-            //            printf(debug("[Put] Reassigning %s! Decremented refcount of %s#%d to %d!"),
-            //                    identifer, get->object.instance->name, get->object.instance->insCount,
-            //                    get->object.instance->refCount);
-        }
-    }
+        insert(identifer, value, env);
+    else
+        slot_put(&get->object, identifer, line, value);
+}
+
+Object* env_lookup(char *identifer, Environment *env){
+    Record *get = env_match(identifer, env);
+    if(get == NULL)
+        return NULL;
+    return &get->object;
+}
+
+Object* env_member(char *identifer, char *container, MemberCache *cache, Environment *env){
+    int slot = cache->slot;
+    if(cache->container == container && slot < env->count && env->records[slot].name == identifer)
+        return &env->records[slot].object;
+    Record *rec = find(identifer, env);
+    if(rec == NULL)
+        return NULL;
+    cache->container = container;
+    cache->slot = rec - env->records;
+    return &rec->object;
 }
 
 Object env_get(char *identifer, int line, Environment *env){
@@ -123,75 +200,166 @@ Object env_get(char *identifer, int line, Environment *env){
     return get->object;
 }
 
-void env_arr_new(char *identifer, int line, long numElements, Environment *env){
+static size_t elementSize(ArrayDataType datatype){
+    if(datatype == ARRAY_INT)
+        return sizeof(long);
+    if(datatype == ARRAY_FLOAT)
+        return sizeof(double);
+    return sizeof(Object);
+}
+
+// Packed elements start out as 0, the others as Null
+static void clearElements(Array *arr, long from){
+    if(arr->datatype != ARRAY_ANY){
+        memset((char *)arr->values + from * elementSize(arr->datatype), 0,
+                (arr->count - from) * elementSize(arr->datatype));
+        return;
+    }
+    while(from < arr->count){
+        arr->values[from].type = OBJECT_NULL;
+        from++;
+    }
+}
+
+static void checkDimension(char *identifer, int line, long numElements, ArrayDataType datatype){
+    if(numElements < 0){
+        printf(runtime_error("Array %s cannot have a negative dimension [%ld]!"), line, identifer, numElements);
+        stop();
+    }
+    if(numElements > ARRAY_MAX_COUNT || (size_t)numElements > GC_MAX_SIZE / elementSize(datatype)){
+        printf(runtime_error("Array dimension too large [%ld]!"), line, numElements);
+        stop();
+    }
+}
+
+static void* newElements(long numElements, ArrayDataType datatype){
+    if(datatype == ARRAY_ANY)
+        return gc_array(numElements);
+    return gc_packed(numElements, elementSize(datatype));
+}
+
+static Object newArray(long numElements, ArrayDataType datatype){
+    Object o;
+    o.type = OBJECT_ARRAY;
+    o.arr.count = numElements;
+    o.arr.datatype = datatype;
+    o.arr.values = (Object *)newElements(numElements, datatype);
+    clearElements(&o.arr, 0);
+    return o;
+}
+
+// Copies into a new buffer, the old one is left to the collector as
+// arguments may still refer to it
+static void resizeArray(Object *arr, char *identifer, int line, long numElements, ArrayDataType datatype){
+    long bak = arr->arr.count < numElements ? arr->arr.count : numElements;
+    if(datatype != arr->arr.datatype){
+        printf(runtime_error("Array %s is already declared with another element type!"), line, identifer);
+        stop();
+    }
+    void *values = newElements(numElements, datatype);
+    memcpy(values, arr->arr.values, elementSize(datatype) * bak);
+    arr->arr.count = numElements;
+    arr->arr.values = (Object *)values;
+    clearElements(&arr->arr, bak);
+}
+
+void env_arr_new(char *identifer, int line, long numElements, ArrayDataType datatype, Environment *env){
     Record *match = env_match(identifer, env);
+    checkDimension(identifer, line, numElements, datatype);
     if(match != NULL && match->object.type != OBJECT_ARRAY)
         printf(runtime_error("Variable %s is already defined!"), line, identifer);
     else if(match != NULL){
-        long bak = match->object.arr.count;
-        match->object.arr.count = numElements;
-        match->object.arr.values = (Object *)reallocate(match->object.arr.values, sizeof(Object)*numElements);
-        while(bak < numElements){
-            match->object.arr.values[bak].type = OBJECT_NULL;
-            bak++;
-        }
+        resizeArray(&match->object, identifer, line, numElements, datatype);
         return;
     }
-    Object o;
-    o.type = OBJECT_ARRAY;
-    o.arr.count = numElements;
-    o.arr.values = (Object *)mallocate(sizeof(Object) * numElements);
-    long i = 0;
-    while(i < numElements){
-        o.arr.values[i].type = OBJECT_NULL;
-        i++;
+    insert(identifer, newArray(numElements, datatype), env);
+}
+
+void slot_arr_new(Object *slot, char *identifer, int line, long numElements, ArrayDataType datatype){
+    checkDimension(identifer, line, numElements, datatype);
+    if(slot->type == OBJECT_ARRAY)
+        resizeArray(slot, identifer, line, numElements, datatype);
+    else if(slot->type != OBJECT_UNDEFINED)
+        printf(runtime_error("Variable %s is already defined!"), line, identifer);
+    else
+        *slot = newArray(numElements, datatype);
+}
+
+// Stores value in a packed array, converting ints for :Float
+static void putPacked(Array *arr, char *identifer, int line, long index, Object value){
+    if(value.type == OBJECT_LITERAL && value.literal.type == LIT_INT){
+        if(arr->datatype == ARRAY_INT)
+            arr->longs[index] = value.literal.iVal;
+        else
+            arr->doubles[index] = value.literal.iVal;
+        return;
+    }
+    if(arr->datatype == ARRAY_FLOAT && value.type == OBJECT_LITERAL && value.literal.type == LIT_DOUBLE){
+        arr->doubles[index] = value.literal.dVal;
+        return;
     }
-    rec_new(identifer, o, env);
+    printf(runtime_error("Array %s only holds %s values!"), line, identifer,
+            arr->datatype == ARRAY_INT ? "Int" : "Float");
+    stop();
 }
 
-void env_arr_put(char *identifer, int line, long index, Object value, Environment *env){
-    Record *get = env_match(identifer, env);
-    if(get == NULL){
+void slot_arr_put(Object *slot, char *identifer, int line, long index, Object value){
+    if(slot == NULL || slot->type == OBJECT_UNDEFINED){
         printf(runtime_error("Undefined array %s!"), line, identifer);
         stop();
     }
-    else if(get->object.type != OBJECT_ARRAY){
+    else if(slot->type != OBJECT_ARRAY){
         printf(runtime_error("Variable %s is not an array!"), line, identifer);
         stop();
     }
-    else if(index < 1 || get->object.arr.count < index){
+    else if(index < 1 || slot->arr.count < index){
         printf(runtime_error("Array index out of range [%ld]!"), line, index);
         stop();
     }
+    arr_put(&slot->arr, identifer, line, index, value);
+}
 
-    get->object.arr.values[index - 1] = value;
+void arr_put(Array *arr, char *identifer, int line, long index, Object value){
+    if(arr->datatype != ARRAY_ANY){
+        putPacked(arr, identifer, line, index - 1, value);
+        return;
+    }
+    share(value);
+    arr->values[index - 1] = value;
 }
 
-Object env_arr_get(char *identifer, int line, long index, Environment *env){ 
-    Record *get = env_match(identifer, env);
-    if(env == NULL){
+Object slot_arr_get(Object *slot, char *identifer, int line, long index){
+    if(slot == NULL || slot->type == OBJECT_UNDEFINED){
         printf(runtime_error("Undefined array %s!"), line, identifer);
         stop();
     }
-    else if(get->object.type != OBJECT_ARRAY){
+    else if(slot->type != OBJECT_ARRAY){
         printf(runtime_error("Subscripted variable %s is not an array or string!"), line, identifer);
         stop();
     }
-    if(index < 1 || get->object.arr.count < index){
+    if(index < 1 || slot->arr.count < index){
         printf(runtime_error("Array index out of range [%ld]!"), line, index);
         stop();
     }
-    return get->object.arr.values[index - 1];
+    return arr_get(&slot->arr, index);
+}
+
+void env_arr_put(char *identifer, int line, long index, Object value, Environment *env){
+    slot_arr_put(env_lookup(identifer, env), identifer, line, index, value);
+}
+
+Object env_arr_get(char *identifer, int line, long index, Environment *env){ 
+    return slot_arr_get(env_lookup(identifer, env), identifer, line, index);
 }
 
-void env_routine_put(Routine r, int line, Environment *env){
-    Record *match = env_match(r.name, env);
+void env_routine_put(Routine *r, int line, Environment *env){
+    Record *match = env_match(r->name, env);
     if(match != NULL){
         if(match->object.type != OBJECT_ROUTINE){
-            printf(runtime_error("Identifer %s cannot be redefined as a routine in the same scope!"), line, r.name);
+            printf(runtime_error("Identifer %s cannot be redefined as a routine in the same scope!"), line, r->name);
         }
         else{
-            printf(runtime_error("Routine %s is already defined!"), line, r.name);
+            printf(runtime_error("Routine %s is already defined!"), line, r->name);
         }
         stop();
     }
@@ -200,10 +368,10 @@ void env_routine_put(Routine r, int line, Environment *env){
     record.type = OBJECT_ROUTINE;
     record.routine = r;
 
-    rec_new(r.name, record, env);
+    insert(r->name, record, env);
 }
 
-Routine env_routine_get(char *identifer, int line, Environment *env){
+Routine* env_routine_get(char *identifer, int line, Environment *env){
     Record *match = env_match(identifer, env);
     if(match == NULL){
         if(strcmp(identifer, "Main") == 0){
@@ -220,14 +388,14 @@ Routine env_routine_get(char *identifer, int line, Environment *env){
     return match->object.routine;
 }
 
-void env_container_put(Container c, int line, Environment *env){
-    Record *match = env_match(c.name, env);
+void env_container_put(Container *c, int line, Environment *env){
+    Record *match = env_match(c->name, env);
     if(match != NULL){
         if(match->object.type != OBJECT_CONTAINER){
-            printf(runtime_error("Identifer %s cannot be redefined as a container in the same scope!"), line, c.name);
+            printf(runtime_error("Identifer %s cannot be redefined as a container in the same scope!"), line, c->name);
         }
         else{
-            printf(runtime_error("Container %s is already defined!"), line, c.name);
+            printf(runtime_error("Container %s is already defined!"), line, c->name);
         }
         stop();
     }
@@ -236,10 +404,10 @@ void env_container_put(Container c, int line, Environment *env){
     o.type = OBJECT_CONTAINER;
     o.container = c;
 
-    rec_new(c.name, o, env);
+    insert(c->name, o, env);
 }
 
-Container env_container_get(char *identifer, int line, Environment *env){
+Container* env_container_get(char *identifer, int line, Environment *env){
     Record *match = env_match(identifer, env);
     if(match == NULL){
         printf(runtime_error("Container %s is not defined!"), line, identifer);
@@ -5,33 +5,75 @@
 #include "interpreter.h"
 
 typedef struct Record{
-    char *name;
+    char *name; // interned symbol
     Object object;
-    struct Record* next;
 } Record;
 
+// Records are kept in insertion order. Once an environment outgrows a
+// linear scan, an open addressing table of record indices keyed on the
+// symbol pointer is built alongside them.
 typedef struct Environment{
-    Record *front;
-    Record *rear;
+    int count;
+    int capacity;
+    Record *records;
+    int tableSize;
+    int *table; // index + 1 into records, 0 if empty
     struct Environment *parent;
 } Environment;
 
+// Identifiers passed to env_* must be interned (see symbol.h)
+
+// Values held are left to the collector, env_free only gives back the
+// environment itself
 Environment *env_new(Environment *parent);
 void env_free(Environment *env);
 
+// Frame environments for routine calls, reused in stack order
+Environment *env_push(Environment *parent, char *name, int line);
+void env_pop(Environment *env);
+// Marks the values of the frames in use, see gc.h
+void env_mark_frames();
+
 void env_put(char *identifer, int line, Object value, Environment *env);
 Object env_get(char *identifer, int line, Environment *env);
+Object* env_lookup(char *identifer, Environment *env);
 
-void env_arr_new(char *identifer, int line, long numElements, Environment *env);
+void env_arr_new(char *identifer, int line, long numElements, ArrayDataType datatype, Environment *env);
 void env_arr_put(char *identifer, int line, long index, Object value, Environment *env);
 Object env_arr_get(char *identifer, int line, long index, Environment *env);
 
-void env_routine_put(Routine r, int line, Environment *env);
-Routine env_routine_get(char *identifer, int line, Environment *env);
+void env_routine_put(Routine *r, int line, Environment *env);
+Routine* env_routine_get(char *identifer, int line, Environment *env);
+
+// Members found in the instance's own environment through an inline
+// cache, NULL if the instance does not hold identifer
+Object* env_member(char *identifer, char *container, MemberCache *cache, Environment *env);
+
+void env_container_put(Container *c, int line, Environment *env);
+Container* env_container_get(char *identifer, int line, Environment *env);
 
-void env_container_put(Container c, int line, Environment *env);
-Container env_container_get(char *identifer, int line, Environment *env);
+// Resolved locals live in flat slot arrays instead of records
+void slot_put(Object *slot, char *identifer, int line, Object value);
+Object slot_get(Object *slot, char *identifer, int line);
+void slot_arr_new(Object *slot, char *identifer, int line, long numElements, ArrayDataType datatype);
+void slot_arr_put(Object *slot, char *identifer, int line, long index, Object value);
+Object slot_arr_get(Object *slot, char *identifer, int line, long index);
 
-void gc_obj(Object o);
+// Elements at an index already known to be in range
+void arr_put(Array *arr, char *identifer, int line, long index, Object value);
+static inline Object arr_get(Array *arr, long index){
+    if(arr->datatype == ARRAY_ANY)
+        return arr->values[index - 1];
+    Object o = {.type = OBJECT_LITERAL};
+    if(arr->datatype == ARRAY_INT){
+        o.literal.type = LIT_INT;
+        o.literal.iVal = arr->longs[index - 1];
+    }
+    else{
+        o.literal.type = LIT_DOUBLE;
+        o.literal.dVal = arr->doubles[index - 1];
+    }
+    return o;
+}
 
 #endif
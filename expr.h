@@ -27,36 +27,90 @@ static const char *literalNames[] = {
     "LIT_NULL"
 };
 
+// Packed to 12 bytes, the value first, so that an Object holding a
+// literal takes 16 (see interpreter.h). Literals carry no line, the
+// expression or statement holding them does.
+#pragma pack(push, 4)
 typedef struct{
-    int line;
-    LiteralType type;
     union{
         int lVal;
         long iVal;
         double dVal;
         char *sVal;
     };
+    LiteralType type;
 } Literal;
+#pragma pack(pop)
+
+// Specialized forms a Binary or Logical node rewrites itself into
+// after its first evaluation, each guarded on its operand types
+typedef enum{
+    QUICK_NONE,         // not evaluated yet
+    QUICK_GENERIC,      // operand types vary, stays generic
+    QUICK_ADD_INT,
+    QUICK_SUBTRACT_INT,
+    QUICK_MULTIPLY_INT,
+    QUICK_DIVIDE_INT,
+    QUICK_MODULO_INT,
+    QUICK_POWER_INT,
+    QUICK_ADD_DOUBLE,
+    QUICK_SUBTRACT_DOUBLE,
+    QUICK_MULTIPLY_DOUBLE,
+    QUICK_DIVIDE_DOUBLE,
+    QUICK_POWER_DOUBLE,
+    QUICK_LESS_INT,
+    QUICK_LESS_EQUAL_INT,
+    QUICK_GREATER_INT,
+    QUICK_GREATER_EQUAL_INT,
+    QUICK_EQUAL_INT,
+    QUICK_NOT_EQUAL_INT,
+    QUICK_LESS_DOUBLE,
+    QUICK_LESS_EQUAL_DOUBLE,
+    QUICK_GREATER_DOUBLE,
+    QUICK_GREATER_EQUAL_DOUBLE,
+    QUICK_EQUAL_DOUBLE,
+    QUICK_NOT_EQUAL_DOUBLE,
+    QUICK_AND_LOGICAL,
+    QUICK_OR_LOGICAL
+} Quick;
 
 typedef struct{
     int line;
     Expression* left;
     Token op;
     Expression* right;
+    Quick quick;
 } Binary;
 
+struct Routine;
+struct Container;
+
+typedef enum{
+    CALL_UNBOUND, // looked up by name when called
+    CALL_ROUTINE,
+    CALL_CONTAINER,
+    CALL_FOREIGN
+} CallType;
+
 // Call
 typedef struct{
     int line;
     char *identifer;
     int argCount;
     Expression **arguments;
+    CallType type; // bound by the linker
+    union{
+        struct Routine *routine;
+        struct Container *container;
+    };
 } Call;
 
 typedef struct{
     int line;
     Expression *index;
     char *identifier;
+    int slot;
+    int unchecked; // in range while the guard of its loop holds, see optimizer.c
 } ArrayExpression;
 
 typedef struct{
@@ -64,17 +118,27 @@ typedef struct{
     Expression* left;
     Token op;
     Expression* right;
+    Quick quick;
 } Logical;
 
 typedef struct{
     int line;
     char* name;
+    int slot; // -1 if the variable is looked up by name
 } Variable;
 
+// Inline cache of a member access site : where the member was last
+// found in an instance of the container
+typedef struct{
+    char *container;
+    int slot;
+} MemberCache;
+
 typedef struct{
     int line;
     Expression *containerName;
     Expression *member;
+    MemberCache cache; // for the leading name of member
 } Reference;
 
 typedef enum{
@@ -107,7 +171,10 @@ typedef struct Expression{
 //        Assign assignment;
         Binary binary;
         Logical logical;
-        Literal literal;
+        struct{
+            int line; // shared by every kind, each starts with its line
+            Literal literal;
+        };
         ArrayExpression arrayExpression;
         Variable variable;
         Call callExpression;
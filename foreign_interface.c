@@ -1,8 +1,13 @@
 #include <stdio.h>
+#include <string.h>
 
 #include "environment.h"
 #include "display.h"
 #include "interpreter.h"
+#include "symbol.h"
+#include "gc.h"
+#include "allocator.h"
+#include "foreign_interface.h"
 
 static int is_num(Object obj){
     return obj.literal.type == LIT_INT || obj.literal.type == LIT_DOUBLE;
@@ -13,7 +18,7 @@ static double get_val(Literal lit){
 }
 
 double get_double(char *identifer, int line, Environment *env){
-    Object o = env_get(identifer, line, env);
+    Object o = env_get(intern(identifer), line, env);
     if(o.type != OBJECT_LITERAL || !is_num(o)){
         printf(runtime_error("Expected numeric value!"), line);
         stop();
@@ -22,7 +27,7 @@ double get_double(char *identifer, int line, Environment *env){
 }
 
 long get_long(char *identifer, int line, Environment *env){
-    Object o = env_get(identifer, line, env);
+    Object o = env_get(intern(identifer), line, env);
     if(o.type != OBJECT_LITERAL || o.literal.type != LIT_INT){
         printf(runtime_error("Expected integer value!"), line);
         stop();
@@ -31,7 +36,7 @@ long get_long(char *identifer, int line, Environment *env){
 }
 
 char* get_string(char *identifer, int line, Environment *env){
-    Object o = env_get(identifer, line, env);
+    Object o = env_get(intern(identifer), line, env);
     if(o.type != OBJECT_LITERAL || o.literal.type != LIT_STRING){
         printf(runtime_error("Expected string value!"), line);
         stop();
@@ -39,6 +44,162 @@ char* get_string(char *identifer, int line, Environment *env){
     return o.literal.sVal;
 }
 
+// Buffers handed out by get_doubles and get_longs, given back once the
+// native that asked for them returns
+static void **scratch = NULL;
+static int scratchCount = 0, scratchCapacity = 0;
+
+static void* scratch_buffer(size_t size){
+    if(scratchCount == scratchCapacity){
+        scratchCapacity = scratchCapacity == 0 ? 8 : scratchCapacity * 2;
+        scratch = (void **)reallocate(scratch, sizeof(void *) * scratchCapacity);
+    }
+    scratch[scratchCount] = mallocate(size);
+    return scratch[scratchCount++];
+}
+
+int foreign_mark(){
+    return scratchCount;
+}
+
+void foreign_release(int mark){
+    while(scratchCount > mark)
+        memfree(scratch[--scratchCount]);
+}
+
+static Array arrayArgument(char *identifer, int line, Environment *env){
+    Object o = env_get(intern(identifer), line, env);
+    if(o.type != OBJECT_ARRAY){
+        printf(runtime_error("Expected array!"), line);
+        stop();
+    }
+    return o.arr;
+}
+
+Object* get_array(char *identifer, int line, Environment *env, long *count){
+    Array arr = arrayArgument(identifer, line, env);
+    if(arr.datatype != ARRAY_ANY){
+        printf(runtime_error("Expected an array without an element type!"), line);
+        stop();
+    }
+    *count = arr.count;
+    return arr.values;
+}
+
+// A :Float array is lent as it is, an :Int one converted
+const double* get_doubles(char *identifer, int line, Environment *env, long *count){
+    Array arr = arrayArgument(identifer, line, env);
+    *count = arr.count;
+    if(arr.datatype == ARRAY_FLOAT)
+        return arr.doubles;
+    double *buffer = (double *)scratch_buffer(sizeof(double) * (*count + 1));
+    long i = 0;
+    while(i < *count){
+        if(arr.datatype == ARRAY_INT)
+            buffer[i] = arr.longs[i];
+        else if(arr.values[i].type != OBJECT_LITERAL || !is_num(arr.values[i])){
+            printf(runtime_error("Expected numeric value at index %ld!"), line, i + 1);
+            stop();
+        }
+        else
+            buffer[i] = get_val(arr.values[i].literal);
+        i++;
+    }
+    return buffer;
+}
+
+const long* get_longs(char *identifer, int line, Environment *env, long *count){
+    Array arr = arrayArgument(identifer, line, env);
+    *count = arr.count;
+    if(arr.datatype == ARRAY_INT)
+        return arr.longs;
+    long *buffer = (long *)scratch_buffer(sizeof(long) * (*count + 1));
+    long i = 0;
+    while(i < *count){
+        if(arr.datatype == ARRAY_FLOAT || arr.values[i].type != OBJECT_LITERAL
+                || arr.values[i].literal.type != LIT_INT){
+            printf(runtime_error("Expected integer value at index %ld!"), line, i + 1);
+            stop();
+        }
+        buffer[i] = arr.values[i].literal.iVal;
+        i++;
+    }
+    return buffer;
+}
+
+double* scratch_doubles(long count){
+    return (double *)scratch_buffer(sizeof(double) * (count + 1));
+}
+
+// Natives carry no line to report
+static void checkCount(long count, size_t size){
+    if(count < 0 || count > ARRAY_MAX_COUNT || (size_t)count > GC_MAX_SIZE / size){
+        printf(error("Bad foreign array size [%ld]!"), count);
+        stop();
+    }
+}
+
+Object new_array(long count, Object **values){
+    Object o;
+    long i = 0;
+    checkCount(count, sizeof(Object));
+    o.type = OBJECT_ARRAY;
+    o.arr.count = count;
+    o.arr.datatype = ARRAY_ANY;
+    o.arr.values = gc_array(count);
+    while(i < count){
+        o.arr.values[i] = nullObject;
+        i++;
+    }
+    *values = o.arr.values;
+    return o;
+}
+
+static Object packed(const void *values, long count, size_t size, ArrayDataType datatype){
+    Object o;
+    checkCount(count, size);
+    o.type = OBJECT_ARRAY;
+    o.arr.count = count;
+    o.arr.datatype = datatype;
+    o.arr.values = (Object *)gc_packed(count, size);
+    memcpy(o.arr.values, values, size * count);
+    return o;
+}
+
+Object from_doubles(const double *values, long count){
+    return packed(values, count, sizeof(double), ARRAY_FLOAT);
+}
+
+Object from_longs(const long *values, long count){
+    return packed(values, count, sizeof(long), ARRAY_INT);
+}
+
+Routine* get_routine(char *identifer, int line, Environment *env){
+    Object o = env_get(intern(identifer), line, env);
+    if(o.type != OBJECT_ROUTINE){
+        printf(runtime_error("Expected routine!"), line);
+        stop();
+    }
+    return o.routine;
+}
+
+Object call_routine(Routine *r, int line, int argc, Object *args){
+    if(r->arity != argc){
+        printf(runtime_error("Argument count mismatch for routine %s! Expected : %d Received %d!"),
+                line, r->name, r->arity, argc);
+        stop();
+    }
+    return call_back(r, args, line);
+}
+
+void hold_object(Object o){
+    gc_push_root(o);
+}
+
+void release_object(){
+    gc_pop_root();
+}
+
 Object fromDouble(double d){
     Object o;
     o.type = OBJECT_LITERAL;
@@ -51,14 +212,16 @@ Object fromLong(long l){
     Object o;
     o.type = OBJECT_LITERAL;
     o.literal.type = LIT_INT;
-    o.literal.dVal = l;
+    o.literal.iVal = l;
     return o;
 }
 
+// Copied, the collector only knows its own strings
 Object fromString(char *string){
     Object o;
     o.type = OBJECT_LITERAL;
     o.literal.type = LIT_STRING;
-    o.literal.sVal = string;
+    o.literal.sVal = gc_string(strlen(string));
+    strcpy(o.literal.sVal, string);
     return o;
 }
@@ -13,4 +13,52 @@ Object fromDouble(double d);
 Object fromLong(long l);
 Object fromString(char *strng);
 
+// Arrays are lent to natives without copying : get_array returns the
+// elements of an untyped array, valid until the native returns.
+// get_doubles and get_longs give the contents as one contiguous, read
+// only buffer, failing unless every element is numeric (or an
+// integer). That is the array's own storage when it is declared :Float
+// (or :Int), a copy otherwise. scratch_doubles gives a buffer to write
+// results in. Copies and scratch buffers are freed when the native
+// returns. new_array builds an untyped array to return, from_doubles
+// and from_longs copy a buffer into a :Float or :Int array.
+Object* get_array(char *identifer, int line, Environment *env, long *count);
+const double* get_doubles(char *identifer, int line, Environment *env, long *count);
+const long* get_longs(char *identifer, int line, Environment *env, long *count);
+double* scratch_doubles(long count);
+Object new_array(long count, Object **values);
+Object from_doubles(const double *values, long count);
+Object from_longs(const long *values, long count);
+// Used around each call to free the buffers it asked for
+int foreign_mark();
+void foreign_release(int mark);
+
+// Calling back into the script. get_routine reads an argument that
+// holds a routine, which can then be called any number of times. The
+// collector may run during a call, so a string, array or instance kept
+// across one has to be held until the native is done with it.
+Routine* get_routine(char *identifer, int line, Environment *env);
+Object call_routine(Routine *r, int line, int argc, Object *args);
+void hold_object(Object o);
+void release_object();
+
+// Routines of the typed convention take and return plain long or
+// double values, so they need neither the environment nor the helpers
+// above. A library lists them in a table named ForeignTable, ended by
+// a NULL name :
+//
+//     ForeignSignature ForeignTable[] = {
+//         {"Sin", "double(double)", (void *)sin},
+//         {NULL, NULL, NULL}
+//     };
+//
+// Up to three arguments are passed, all of the same type. An entry with
+// a NULL signature is called as (line, env), like routines that are
+// not in the table and are looked up by name.
+typedef struct{
+    const char *name;
+    const char *signature;
+    void *function;
+} ForeignSignature;
+
 #endif
@@ -0,0 +1,217 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "display.h"
+#include "allocator.h"
+#include "gc.h"
+#include "vm.h"
+
+#define KB 1024
+
+int gcPending = 0;
+
+static GcObject *objects = NULL;
+static size_t heapSize = 0; // bytes held by collected objects
+static size_t threshold = 1024 * KB, nextCollection = 1024 * KB;
+static size_t heapLimit = 0; // 0 if unbounded
+static double growth = 2;
+
+static Environment *globalEnv = NULL;
+
+// Marked objects whose children are still to be visited
+static GcObject **gray = NULL;
+static int grayCount = 0, grayCapacity = 0;
+
+static Object *roots = NULL;
+static int rootCount = 0, rootCapacity = 0;
+
+static void* allocate(GcType type, size_t size){
+    GcObject *o = (GcObject *)mallocate(sizeof(GcObject) + size);
+    o->next = objects;
+    o->size = size;
+    o->type = type;
+    o->marked = 0;
+    objects = o;
+    heapSize += sizeof(GcObject) + size;
+    if(heapSize > nextCollection)
+        gcPending = 1;
+    return o + 1;
+}
+
+char* gc_string(size_t length){
+    return gc_string_room(length, length);
+}
+
+char* gc_string_room(size_t length, size_t capacity){
+    return str_init(allocate(GC_STRING, sizeof(String) + sizeof(char) * (capacity + 1)), length, 1);
+}
+
+size_t gc_string_capacity(const char *s){
+    return ((GcObject *)str_header(s) - 1)->size - sizeof(String) - 1;
+}
+
+Object* gc_array(long count){
+    return (Object *)allocate(GC_ARRAY, sizeof(Object) * count);
+}
+
+void* gc_packed(long count, size_t size){
+    return allocate(GC_PACKED, size * count);
+}
+
+// The environment is freed along with the instance, count it as well
+Instance* gc_instance(){
+    Instance *ins = (Instance *)allocate(GC_INSTANCE, sizeof(Instance));
+    heapSize += sizeof(Environment);
+    return ins;
+}
+
+void gc_push_root(Object o){
+    if(rootCount == rootCapacity){
+        rootCapacity = rootCapacity == 0 ? 64 : rootCapacity * 2;
+        roots = (Object *)reallocate(roots, sizeof(Object) * rootCapacity);
+    }
+    roots[rootCount++] = o;
+}
+
+void gc_pop_root(){
+    rootCount--;
+}
+
+void gc_init(Environment *global){
+    globalEnv = global;
+    if(heapLimit > 0 && nextCollection > heapLimit)
+        nextCollection = heapLimit;
+}
+
+static void markHeader(GcObject *o){
+    if(o->marked)
+        return;
+    o->marked = 1;
+    if(o->type == GC_STRING || o->type == GC_PACKED)
+        return;
+    if(grayCount == grayCapacity){
+        grayCapacity = grayCapacity == 0 ? 256 : grayCapacity * 2;
+        gray = (GcObject **)reallocate(gray, sizeof(GcObject *) * grayCapacity);
+    }
+    gray[grayCount++] = o;
+}
+
+void gc_mark(Object o){
+    switch(o.type){
+        case OBJECT_LITERAL:
+            if(o.literal.type == LIT_STRING && str_header(o.literal.sVal)->heap)
+                markHeader((GcObject *)str_header(o.literal.sVal) - 1);
+            break;
+        case OBJECT_ARRAY:
+            markHeader((GcObject *)o.arr.values - 1);
+            break;
+        case OBJECT_INSTANCE:
+            if(o.instance != NULL)
+                markHeader((GcObject *)o.instance - 1);
+            break;
+        default:
+            break;
+    }
+}
+
+void gc_mark_env(Environment *env){
+    int i = 0;
+    while(i < env->count){
+        gc_mark(env->records[i].object);
+        i++;
+    }
+}
+
+// Children are visited through the gray stack instead of recursion, so
+// long chains of instances do not exhaust the C stack
+static void trace(){
+    while(grayCount > 0){
+        GcObject *o = gray[--grayCount];
+        if(o->type == GC_ARRAY){
+            Object *values = (Object *)(o + 1);
+            long i = 0, count = o->size / sizeof(Object);
+            while(i < count){
+                gc_mark(values[i]);
+                i++;
+            }
+        }
+        else
+            gc_mark_env((Environment *)((Instance *)(o + 1))->environment);
+    }
+}
+
+static void release(GcObject *o){
+    heapSize -= sizeof(GcObject) + o->size;
+    if(o->type == GC_INSTANCE){
+        heapSize -= sizeof(Environment);
+        env_free((Environment *)((Instance *)(o + 1))->environment);
+    }
+    memfree(o);
+}
+
+static void sweep(){
+    GcObject **link = &objects;
+    while(*link != NULL){
+        GcObject *o = *link;
+        if(o->marked){
+            o->marked = 0;
+            link = &o->next;
+        }
+        else{
+            *link = o->next;
+            release(o);
+        }
+    }
+}
+
+void gc_collect(){
+    int i = 0;
+    if(globalEnv != NULL)
+        gc_mark_env(globalEnv);
+    env_mark_frames();
+    vm_mark_roots();
+    while(i < rootCount){
+        gc_mark(roots[i]);
+        i++;
+    }
+    trace();
+    sweep();
+    if(heapLimit > 0 && heapSize > heapLimit){
+        printf(error("Heap limit of %zu KB exceeded, %zu KB are still reachable!"),
+                heapLimit / KB, heapSize / KB);
+        stop();
+    }
+    nextCollection = heapSize * growth;
+    if(nextCollection < threshold)
+        nextCollection = threshold;
+    if(heapLimit > 0 && nextCollection > heapLimit)
+        nextCollection = heapLimit;
+    gcPending = 0;
+}
+
+static int sizeOption(const char *option, const char *name, size_t *value){
+    size_t length = strlen(name);
+    long kb;
+    if(strncmp(option, name, length) != 0)
+        return 0;
+    kb = atol(option + length);
+    if(kb <= 0)
+        return 0;
+    *value = kb * KB;
+    return 1;
+}
+
+int gc_option(const char *option){
+    if(sizeOption(option, "--gc-threshold=", &threshold)){
+        nextCollection = threshold;
+        return 1;
+    }
+    if(sizeOption(option, "--heap-limit=", &heapLimit))
+        return 1;
+    if(strncmp(option, "--gc-growth=", 12) == 0){
+        growth = atof(option + 12);
+        return growth >= 1;
+    }
+    return 0;
+}
@@ -0,0 +1,65 @@
+#ifndef GC_H
+#define GC_H
+
+#include <stddef.h>
+#include <limits.h>
+
+#include "interpreter.h"
+#include "environment.h"
+#include "str.h"
+
+// Strings built at runtime, array buffers and container instances are
+// owned by a mark and sweep collector. Each carries a header right
+// before the memory handed out, strings have theirs in front of the
+// string header (see str.h).
+
+typedef enum{
+    GC_STRING,
+    GC_ARRAY,
+    GC_PACKED, // elements of :Int and :Float arrays, nothing to trace
+    GC_INSTANCE
+} GcType;
+
+typedef struct GcObject{
+    struct GcObject *next;
+    unsigned int size; // bytes after the header
+    unsigned char type;
+    unsigned char marked;
+} GcObject;
+
+#define GC_MAX_SIZE UINT_MAX // largest object, in bytes
+
+// Collections only run at safepoints : loop back edges and calls, where
+// every live value is reachable from an environment, the vm stack or
+// the root stack below
+extern int gcPending;
+#define gc_safepoint() if(gcPending) gc_collect()
+
+char* gc_string(size_t length); // room for length chars and the terminator
+// Room for capacity chars, to be appended to while nothing else holds it
+char* gc_string_room(size_t length, size_t capacity);
+size_t gc_string_capacity(const char *s);
+Object* gc_array(long count);
+void* gc_packed(long count, size_t size);
+Instance* gc_instance();
+
+// Whether o refers to memory owned by the collector
+static inline int gc_traced(Object o){
+    return o.type == OBJECT_ARRAY || o.type == OBJECT_INSTANCE
+        || (o.type == OBJECT_LITERAL && o.literal.type == LIT_STRING);
+}
+
+// Temporaries the tree-walker holds in C locals across a call
+void gc_push_root(Object o);
+void gc_pop_root();
+
+void gc_init(Environment *global);
+void gc_mark(Object o);
+void gc_mark_env(Environment *env);
+void gc_collect();
+
+// Parses --gc-threshold=KB, --gc-growth=N and --heap-limit=KB,
+// returns 0 for anything else
+int gc_option(const char *option);
+
+#endif
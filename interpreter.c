@@ -12,368 +12,368 @@
 #include "io.h"
 #include "interpreter.h"
 #include "native.h"
-
-#define EPSILON 0.0000000000000000000000001
-
+#include "runtime.h"
+#include "compiler.h"
+#include "vm.h"
+#include "symbol.h"
+#include "gc.h"
 
 static Object resolveExpression(Expression* expression, Environment *env);
 static Object executeBlock(Block b, Environment *env);
 
-static int instanceCount = 0;
 static Environment *globalEnv = NULL;
+static char *mainSymbol = NULL;
 
 static int brk = 0, ret = 0;
-
-static int isNumeric(Literal l){
-    return l.type == LIT_INT || l.type == LIT_DOUBLE;
-}
+static int walking = 0; // whether the tree-walker runs the script
 
 static Literal resolveLiteral(Expression *expression, int line, Environment *env){
-    Object o = resolveExpression(expression, env);
-    if(o.type == OBJECT_NULL)
-        return nullLiteral;
-    if(o.type != OBJECT_LITERAL){
-        printf(runtime_error("Expected literal, Received %d!"), line, o.type);
-        stop();
-    }
-    return o.literal;
-}
-
-static Object fromLiteral(Literal l){
-    Object o = {OBJECT_LITERAL, {l}};
-    return o;
-}
-
-static Object resolveBinary(Binary expr, Environment *env){
-    Literal left = resolveLiteral(expr.left, expr.line, env);
-    Literal right = resolveLiteral(expr.right, expr.line, env);
-    //   printf("\n[Binary] Got %s and %s for operator %s", literalNames[left.type], literalNames[right.type], tokenNames[expr.op.type]);
-    if(left.type == LIT_STRING && right.type == LIT_STRING && expr.op.type == TOKEN_PLUS){
-        Literal ret = {expr.line, LIT_STRING, {0}};
-        ret.sVal = (char *)mallocate(sizeof(char) * (strlen(left.sVal) + strlen(right.sVal) + 1));
-        ret.sVal[0] = 0;
-        strcat(ret.sVal, left.sVal);
-        strcat(ret.sVal, right.sVal);
-        return fromLiteral(ret);
-    }
-    else if (!isNumeric(left) || !isNumeric(right)){
-        printf(runtime_error("Binary operation can only be done on numerical values!"), expr.line);
-        stop();
-        return nullObject;
-    }
-    Literal ret = {expr.line, LIT_NULL, {0}};
-    ret.line = left.line;
-    if(left.type == LIT_INT && right.type == LIT_INT){
-        ret.type = LIT_INT;
-        switch(expr.op.type){
-            case TOKEN_PLUS:
-                ret.iVal = left.iVal + right.iVal;
-                break;
-            case TOKEN_MINUS:
-                ret.iVal = left.iVal - right.iVal;
-                break;
-            case TOKEN_STAR:
-                ret.iVal = left.iVal * right.iVal;
-                break;
-            case TOKEN_SLASH:
-                ret.iVal = left.iVal / right.iVal;
-                break;
-            case TOKEN_CARET:
-                ret.iVal = pow(left.iVal, right.iVal);
-                break;
-            case TOKEN_PERCEN:
-                ret.iVal = left.iVal % right.iVal;
-                break;
-            default:
-                break;
+    return toLiteral(resolveExpression(expression, env), line);
+}
+
+// Picks the specialized form for the operand types seen on the first
+// evaluation. Mixed int and double operands stay generic.
+static Quick quicken(TokenType op, LiteralType left, LiteralType right){
+    if(left != right)
+        return QUICK_GENERIC;
+    if(left == LIT_INT){
+        switch(op){
+            case TOKEN_PLUS: return QUICK_ADD_INT;
+            case TOKEN_MINUS: return QUICK_SUBTRACT_INT;
+            case TOKEN_STAR: return QUICK_MULTIPLY_INT;
+            case TOKEN_SLASH: return QUICK_DIVIDE_INT;
+            case TOKEN_PERCEN: return QUICK_MODULO_INT;
+            case TOKEN_CARET: return QUICK_POWER_INT;
+            case TOKEN_LESS: return QUICK_LESS_INT;
+            case TOKEN_LESS_EQUAL: return QUICK_LESS_EQUAL_INT;
+            case TOKEN_GREATER: return QUICK_GREATER_INT;
+            case TOKEN_GREATER_EQUAL: return QUICK_GREATER_EQUAL_INT;
+            case TOKEN_EQUAL_EQUAL: return QUICK_EQUAL_INT;
+            case TOKEN_BANG_EQUAL: return QUICK_NOT_EQUAL_INT;
+            default: return QUICK_GENERIC;
         }
     }
-    else{
-        ret.type = LIT_DOUBLE;
-        double a = left.type == LIT_INT?left.iVal:left.dVal;
-        double b = right.type == LIT_INT?right.iVal:right.dVal;
-        switch(expr.op.type){
-            case TOKEN_PLUS:
-                ret.dVal = a + b;
-                break;
-            case TOKEN_MINUS:
-                ret.dVal = a - b;
-                break;
-            case TOKEN_STAR:
-                ret.dVal = a * b;
-                break;
-            case TOKEN_SLASH:
-                ret.dVal = a / b;
-                break;
-            case TOKEN_CARET:
-                ret.dVal = pow(a, b);
-                break;
-            case TOKEN_PERCEN:
-                printf(runtime_error("%% can only be applied between two integers!"), expr.line);
-                stop();
-                break;
-            default:
-                break;
+    if(left == LIT_DOUBLE){
+        switch(op){
+            case TOKEN_PLUS: return QUICK_ADD_DOUBLE;
+            case TOKEN_MINUS: return QUICK_SUBTRACT_DOUBLE;
+            case TOKEN_STAR: return QUICK_MULTIPLY_DOUBLE;
+            case TOKEN_SLASH: return QUICK_DIVIDE_DOUBLE;
+            case TOKEN_CARET: return QUICK_POWER_DOUBLE;
+            case TOKEN_LESS: return QUICK_LESS_DOUBLE;
+            case TOKEN_LESS_EQUAL: return QUICK_LESS_EQUAL_DOUBLE;
+            case TOKEN_GREATER: return QUICK_GREATER_DOUBLE;
+            case TOKEN_GREATER_EQUAL: return QUICK_GREATER_EQUAL_DOUBLE;
+            case TOKEN_EQUAL_EQUAL: return QUICK_EQUAL_DOUBLE;
+            case TOKEN_BANG_EQUAL: return QUICK_NOT_EQUAL_DOUBLE;
+            default: return QUICK_GENERIC;
         }
     }
-    return fromLiteral(ret);
+    if(left == LIT_LOGICAL){
+        if(op == TOKEN_AND)
+            return QUICK_AND_LOGICAL;
+        if(op == TOKEN_OR)
+            return QUICK_OR_LOGICAL;
+    }
+    return QUICK_GENERIC;
+}
+
+#define GUARD(t) if(a->type != (t) || b->type != (t)) return 0
+#define INT_OP(op) GUARD(LIT_INT); a->iVal = a->iVal op b->iVal; return 1
+#define DOUBLE_OP(op) GUARD(LIT_DOUBLE); a->dVal = a->dVal op b->dVal; return 1
+// Compared as doubles, like the generic path
+#define INT_COMPARE(op) GUARD(LIT_INT); a->lVal = (double)a->iVal op (double)b->iVal; a->type = LIT_LOGICAL; return 1
+#define DOUBLE_COMPARE(op) GUARD(LIT_DOUBLE); a->lVal = a->dVal op b->dVal; a->type = LIT_LOGICAL; return 1
+
+// Writes the result over the left operand, which keeps its line like
+// the generic result does. Returns 0 if a guard fails.
+static inline int quickOp(Quick quick, Literal *a, const Literal *b){
+    switch(quick){
+        case QUICK_ADD_INT: INT_OP(+);
+        case QUICK_SUBTRACT_INT: INT_OP(-);
+        case QUICK_MULTIPLY_INT: INT_OP(*);
+        case QUICK_DIVIDE_INT: INT_OP(/);
+        case QUICK_MODULO_INT: INT_OP(%);
+        case QUICK_POWER_INT:
+            GUARD(LIT_INT);
+            a->iVal = intPower(a->iVal, b->iVal);
+            return 1;
+        case QUICK_ADD_DOUBLE: DOUBLE_OP(+);
+        case QUICK_SUBTRACT_DOUBLE: DOUBLE_OP(-);
+        case QUICK_MULTIPLY_DOUBLE: DOUBLE_OP(*);
+        case QUICK_DIVIDE_DOUBLE: DOUBLE_OP(/);
+        case QUICK_POWER_DOUBLE:
+            GUARD(LIT_DOUBLE);
+            a->dVal = pow(a->dVal, b->dVal);
+            return 1;
+        case QUICK_LESS_INT: INT_COMPARE(<);
+        case QUICK_LESS_EQUAL_INT: INT_COMPARE(<=);
+        case QUICK_GREATER_INT: INT_COMPARE(>);
+        case QUICK_GREATER_EQUAL_INT: INT_COMPARE(>=);
+        case QUICK_EQUAL_INT: INT_COMPARE(==);
+        case QUICK_NOT_EQUAL_INT: INT_COMPARE(!=);
+        case QUICK_LESS_DOUBLE: DOUBLE_COMPARE(<);
+        case QUICK_LESS_EQUAL_DOUBLE: DOUBLE_COMPARE(<=);
+        case QUICK_GREATER_DOUBLE: DOUBLE_COMPARE(>);
+        case QUICK_GREATER_EQUAL_DOUBLE: DOUBLE_COMPARE(>=);
+        case QUICK_EQUAL_DOUBLE:
+            GUARD(LIT_DOUBLE);
+            a->lVal = fabs(a->dVal - b->dVal) <= EPSILON;
+            a->type = LIT_LOGICAL;
+            return 1;
+        case QUICK_NOT_EQUAL_DOUBLE:
+            GUARD(LIT_DOUBLE);
+            a->lVal = fabs(a->dVal - b->dVal) > EPSILON;
+            a->type = LIT_LOGICAL;
+            return 1;
+        case QUICK_AND_LOGICAL:
+            GUARD(LIT_LOGICAL);
+            a->lVal = a->lVal & b->lVal;
+            return 1;
+        case QUICK_OR_LOGICAL:
+            GUARD(LIT_LOGICAL);
+            a->lVal = a->lVal | b->lVal;
+            return 1;
+        default:
+            return 0;
+    }
 }
 
-static Object compareInstance(Logical expr, Environment *env){
-    Object a = resolveExpression(expr.left, env);
-    Object b = resolveExpression(expr.right, env);
-    if(a.type == OBJECT_INSTANCE && b.type == OBJECT_INSTANCE){
-        Literal ret = {expr.line, LIT_LOGICAL, {0}};
-        switch(expr.op.type){
-            case TOKEN_EQUAL_EQUAL:
-                ret.lVal = a.instance == b.instance;
-                break;
-            case TOKEN_BANG_EQUAL:
-                ret.lVal = a.instance != b.instance;
-                break;
-            default:
-                printf(runtime_error("Can't compare container instances!"), expr.line);
-                stop();
-                break;
-        }
-        return fromLiteral(ret);
-    }
-    else if((a.type == OBJECT_INSTANCE && b.type == OBJECT_LITERAL)
-            || (a.type == OBJECT_LITERAL && b.type == OBJECT_INSTANCE)){
-        Literal lit = a.type == OBJECT_LITERAL ? a.literal : b.literal;
-        Instance* o = a.type == OBJECT_INSTANCE ? a.instance : b.instance;
-        if(lit.type != LIT_NULL){
-            printf(runtime_error("Unable to compare between literal and instances!"), expr.line);
-            stop();
-        }
-        Literal ret = {expr.line, LIT_LOGICAL, {0}};
-        switch(expr.op.type){
-            case TOKEN_EQUAL_EQUAL: 
-                ret.lVal = o == NULL;
-                break;
-            case TOKEN_BANG_EQUAL:
-                ret.lVal = o != NULL;
-                break;
-            default:
-                printf(runtime_error("Null can't be compared!"), expr.line);
-                stop();
-                break;
-        }
-        return fromLiteral(ret);
-    }
-    return nullObject;
+#undef GUARD
+#undef INT_OP
+#undef DOUBLE_OP
+#undef INT_COMPARE
+#undef DOUBLE_COMPARE
+
+// The left operand lives only here while the right one is evaluated, a
+// call in there may reach a safepoint
+static Object resolveOperand(Object left, Expression *right, Environment *env){
+    if(!gc_traced(left))
+        return resolveExpression(right, env);
+    gc_push_root(left);
+    Object o = resolveExpression(right, env);
+    gc_pop_root();
+    return o;
 }
 
-static Object resolveLogical(Logical expr, Environment *env){
-    Object r = compareInstance(expr, env);
-    if(r.type != OBJECT_NULL)
-        return r;
-    Literal left = resolveLiteral(expr.left, expr.line, env);
-    Literal right = resolveLiteral(expr.right, expr.line, env);
-    //    printf("\n[Logical] Got %s and %s for operator %s", literalNames[left.type], literalNames[right.type], tokenNames[expr.op.type]);
-    if(left.type == LIT_NULL || right.type == LIT_NULL){
-        Literal ret = {expr.line, LIT_LOGICAL, {0}};
-        switch(expr.op.type){
-            case TOKEN_EQUAL_EQUAL:
-                ret.lVal = left.type == LIT_NULL && right.type == LIT_NULL;
-                break;
-            case TOKEN_BANG_EQUAL:
-                ret.lVal = left.type != LIT_NULL || right.type != LIT_NULL;
-                break;
-            default:
-                printf(runtime_error("Unable to compare Null!"), expr.line);
-                break;
+// Quickened nodes read a literal right operand straight from the tree.
+// A failed guard turns the node generic for good.
+static Object resolveBinary(Binary *expr, Environment *env){
+    Object left = resolveExpression(expr->left, env);
+    if(expr->quick > QUICK_GENERIC && left.type == OBJECT_LITERAL){
+        Object right;
+        if(expr->right->type == EXPR_LITERAL)
+            right.literal = expr->right->literal;
+        else{
+            right = resolveOperand(left, expr->right, env);
+            if(right.type != OBJECT_LITERAL){
+                expr->quick = QUICK_GENERIC;
+                return binaryOp(left.literal, toLiteral(right, expr->line), expr->op.type, expr->line);
+            }
         }
-        return fromLiteral(ret);
-    }
-    if(left.type == LIT_STRING && right.type == LIT_STRING){
-        Literal ret = {expr.line, LIT_LOGICAL, {0}};
-        ret.line = left.line;
-        switch(expr.op.type){
-            case TOKEN_GREATER:
-                ret.lVal = strlen(left.sVal) > strlen(right.sVal);
-                break;
-            case TOKEN_GREATER_EQUAL:
-                ret.lVal = strlen(left.sVal) >= strlen(right.sVal);
-                break;
-            case TOKEN_LESS:
-                ret.lVal = strlen(left.sVal) < strlen(right.sVal);
-                break;
-            case TOKEN_LESS_EQUAL:
-                ret.lVal = strlen(left.sVal) <= strlen(right.sVal);
-                break;
-            case TOKEN_EQUAL_EQUAL:
-                ret.lVal = strcmp(left.sVal, right.sVal) == 0?1:0;
-                break;
-            case TOKEN_BANG_EQUAL:
-                ret.lVal = strcmp(left.sVal, right.sVal) == 0?0:1;
-                break;
-            default:
-                printf(runtime_error("Bad logical operator between string operands!"), expr.line);
-                stop();
-                break;
+        if(quickOp(expr->quick, &left.literal, &right.literal))
+            return left;
+        expr->quick = QUICK_GENERIC;
+        return binaryOp(left.literal, right.literal, expr->op.type, expr->line);
+    }
+    Literal l = toLiteral(left, expr->line);
+    Literal r = toLiteral(resolveOperand(left, expr->right, env), expr->line);
+    Object result = binaryOp(l, r, expr->op.type, expr->line);
+    if(expr->quick == QUICK_NONE)
+        expr->quick = quicken(expr->op.type, l.type, r.type);
+    return result;
+}
+
+static Object resolveLogical(Logical *expr, Environment *env){
+    Object left = resolveExpression(expr->left, env);
+    if(expr->quick > QUICK_GENERIC && left.type == OBJECT_LITERAL){
+        if(expr->right->type == EXPR_LITERAL){
+            if(quickOp(expr->quick, &left.literal, &expr->right->literal))
+                return left;
         }
-        return fromLiteral(ret);
-    }
-    else if((!isNumeric(left) && left.type != LIT_LOGICAL) 
-            || (!isNumeric(right) && right.type != LIT_LOGICAL)){
-        printf(runtime_error("Bad operand for logical operator!"), expr.line);
-        stop();
-        return nullObject;
+        else{
+            Object right = resolveOperand(left, expr->right, env);
+            if(right.type == OBJECT_LITERAL && quickOp(expr->quick, &left.literal, &right.literal))
+                return left;
+            expr->quick = QUICK_GENERIC;
+            return logicalOp(left, right, expr->op.type, expr->line);
+        }
+        expr->quick = QUICK_GENERIC;
     }
-    Literal ret;
-    ret.type = LIT_LOGICAL;
-    ret.line = left.line;
-    double a = left.type == LIT_INT?left.iVal:left.dVal;
-    double b = right.type == LIT_INT?right.iVal:right.dVal;
-    switch(expr.op.type){
-        case TOKEN_GREATER:
-            ret.lVal = a > b;
-            break;
-        case TOKEN_GREATER_EQUAL:
-            ret.lVal = a >= b;
-            break;
-        case TOKEN_LESS:
-            ret.lVal = a < b;
-            break;
-        case TOKEN_LESS_EQUAL:
-            ret.lVal = a <= b;
-            break;
-        case TOKEN_EQUAL_EQUAL:
-            ret.lVal = fabs(a - b) <= EPSILON;
-            break;
-        case TOKEN_BANG_EQUAL:
-            ret.lVal = fabs(a - b) > EPSILON;
-            break;
-        case TOKEN_AND:
-            if(left.type != LIT_LOGICAL || right.type != LIT_LOGICAL){
-                printf(runtime_error("'And' can only be applied over logical expressions!"), expr.line);
-                stop();
-            }
-            ret.lVal = left.lVal & right.lVal;
-            break;
-        case TOKEN_OR:
-            if(left.type != LIT_LOGICAL || right.type != LIT_LOGICAL){
-                printf(runtime_error("'Or' can only be applied over logical expressions!"), expr.line);
-                stop();
-            }
-            ret.lVal = left.lVal | right.lVal;
-            break;
-        default:
-            break;
+    Object right = resolveOperand(left, expr->right, env);
+    Object result = logicalOp(left, right, expr->op.type, expr->line);
+    if(expr->quick == QUICK_NONE){
+        if(left.type == OBJECT_LITERAL && right.type == OBJECT_LITERAL)
+            expr->quick = quicken(expr->op.type, left.literal.type, right.literal.type);
+        else
+            expr->quick = QUICK_GENERIC;
     }
-    return fromLiteral(ret);
+    return result;
 }
 
 static Object resolveVariable(Variable expr, Environment *env){
+    if(expr.slot < 0)
+        return readNamed(env_get(expr.name, expr.line, env));
     return env_get(expr.name, expr.line, env);
 }
 
 static Object resolveArray(ArrayExpression ae, Environment *env){
     Literal index = resolveLiteral(ae.index, ae.line, env);
-    if(index.type != LIT_INT){
-        printf(runtime_error("Array index must be an integer!"), ae.line);
-        stop();
-    }
-    Object get = env_get(ae.identifier, ae.line, env);
-    if(get.type == OBJECT_LITERAL && get.literal.type == LIT_STRING){ 
-        char *s = get.literal.sVal;
-        long le = strlen(s);
-        long in = index.lVal;
-        if(in < 1 || in > (le+1)){
-            printf(runtime_error("String index out of range [%ld]!"), ae.line, in);
-            stop();
-        }
-        if(in == le+1)
-            return nullObject;
-        char c = s[in - 1];
-        char *cs = (char *)mallocate(sizeof(char) * 2);
-        cs[0] = c;
-        cs[1] = '\0';
-        Literal l;
-        l.type =  LIT_STRING;
-        l.sVal = cs;
-        return fromLiteral(l);
-    }
-    return env_arr_get(ae.identifier, ae.line, index.iVal, env);
-}
-
-static Object resolveRoutineCall(Call c, Environment *env){
-    Routine r = env_routine_get(c.identifer, c.line, globalEnv);
-    //printf("\nResolving call to %s", c.identifer);
-    if(r.arity != c.argCount){
-        printf(runtime_error("Argument count mismatch for routine %s! Expected : %d Received %d!"), 
-                c.line, c.identifer, r.arity, c.argCount);
-        stop();
-        return nullObject;
-    }
-    Environment *routineEnv = env_new(globalEnv);
+    return readIndex(env_lookup(ae.identifier, env), ae.identifier, index, ae.line);
+}
+
+static Object invokeTyped(Routine *r, Call *c, Environment *env){
+    Object args[FOREIGN_MAX_ARGS];
     int i = 0;
-    // printf("\n[Call] Executing %s Arity : %d\n", r.name, r.arity);
-    while(i < r.arity){
-        //   printf(debug("Argument %s"), r.arguments[i]);
-        env_put(r.arguments[i], c.line, resolveExpression(c.arguments[i], env), routineEnv);
+    while(i < r->arity){
+        args[i] = resolveExpression(c->arguments[i], env);
         i++;
     }
+    return call_typed(r, args, c->line);
+}
+
+// Runs r once its arguments are bound in routineEnv
+static Object enterRoutine(Routine *r, Environment *routineEnv, int line){
+    gc_safepoint();
     Object obj;
-    if(r.isNative == 1)
-        obj = handle_native(c, routineEnv);
-    // printf("\n[Call] Executing %s\n", r.name);
+    if(r->isNative == 1)
+        obj = handle_native(r, line, routineEnv);
+    // printf("\n[Call] Executing %s\n", r->name);
     else
-        obj = executeBlock(r.code, routineEnv);
+        obj = executeBlock(r->code, routineEnv);
     if(ret)
         ret = 0;
-    env_free(routineEnv);
+    env_pop(routineEnv);
     return obj;
 }
 
-static Object resolveContainerCall(Call c, Environment *env){
-    Container r = env_container_get(c.identifer, c.line, globalEnv);
-    //printf("\nResolving call to %s", c.identifer); 
-    if(r.arity != c.argCount){
-        printf(runtime_error("Argument count mismatch for container %s! Expected : %d Received %d!"), 
-                c.line, c.identifer, r.arity, c.argCount);
-        stop();
-        return nullObject;
+static Object invokeRoutine(Routine *r, Call *c, Environment *env){
+    if(r->isNative == 1 && native_typed(r, c->line))
+        return invokeTyped(r, c, env);
+    Environment *routineEnv = env_push(globalEnv, r->name, c->line);
+    int i = 0;
+    // printf("\n[Call] Executing %s Arity : %d\n", r->name, r->arity);
+    while(i < r->arity){
+        //   printf(debug("Argument %s"), r->arguments[i]);
+        env_put(r->arguments[i], c->line, resolveExpression(c->arguments[i], env), routineEnv);
+        i++;
+    }
+    return enterRoutine(r, routineEnv, c->line);
+}
+
+// Calls made by natives, with the arguments already evaluated
+static Object walkCall(Routine *r, Object *args, int line){
+    if(r->isNative == 1 && native_typed(r, line))
+        return call_typed(r, args, line);
+    Environment *routineEnv = env_push(globalEnv, r->name, line);
+    int i = 0;
+    while(i < r->arity){
+        env_put(r->arguments[i], line, args[i], routineEnv);
+        i++;
     }
+    return enterRoutine(r, routineEnv, line);
+}
+
+// The instance is made up front, so that the collector finds the
+// environment while the constructor runs
+static Object invokeContainer(Container *r, Call *c, Environment *env){
     Environment *containerEnv = env_new(globalEnv);
+    Object instance = newInstance(r->name, containerEnv);
     int i = 0;
-    // printf("\n[Call] Executing container %s\n", r.name);
-    while(i < r.arity){
-        env_put(r.arguments[i], c.line, resolveExpression(c.arguments[i], env), containerEnv);
+    gc_push_root(instance);
+    // printf("\n[Call] Executing container %s\n", r->name);
+    while(i < r->arity){
+        env_put(r->arguments[i], c->line, resolveExpression(c->arguments[i], env), containerEnv);
         i++;
     }
-    // printf("\n[Call] Executing %s\n", r.name);
-    executeBlock(r.constructor, containerEnv);
-    Object o;
-    o.type = OBJECT_INSTANCE;
-    o.instance = (Instance *)mallocate(sizeof(Instance));
-    o.instance->name = r.name;
-    o.instance->environment = containerEnv;
-    o.instance->refCount = 0;
-    o.instance->insCount = ++instanceCount;
-    o.instance->fromReturn = 0;
-    return o;
+    gc_safepoint();
+    // printf("\n[Call] Executing %s\n", r->name);
+    executeBlock(r->constructor, containerEnv);
+    gc_pop_root();
+    return instance;
+}
+
+static Object resolveRoutineCall(Call *c, Environment *env){
+    Routine *r = env_routine_get(c->identifer, c->line, globalEnv);
+    //printf("\nResolving call to %s", c->identifer);
+    if(r->arity != c->argCount){
+        printf(runtime_error("Argument count mismatch for routine %s! Expected : %d Received %d!"), 
+                c->line, c->identifer, r->arity, c->argCount);
+        stop();
+        return nullObject;
+    }
+    return invokeRoutine(r, c, env);
+}
+
+static Object resolveContainerCall(Call *c, Environment *env){
+    Container *r = env_container_get(c->identifer, c->line, globalEnv);
+    //printf("\nResolving call to %s", c->identifer); 
+    if(r->arity != c->argCount){
+        printf(runtime_error("Argument count mismatch for container %s! Expected : %d Received %d!"), 
+                c->line, c->identifer, r->arity, c->argCount);
+        stop();
+        return nullObject;
+    }
+    return invokeContainer(r, c, env);
 }
 
-static Object resolveCall(Call c, Environment *env){
-    if(strcmp(c.identifer, "Main") == 0)
+static Object resolveCall(Call *c, Environment *env){
+    switch(c->type){
+        case CALL_ROUTINE:
+        case CALL_FOREIGN:
+            return invokeRoutine(c->routine, c, env);
+        case CALL_CONTAINER:
+            return invokeContainer(c->container, c, env);
+        default:
+            break;
+    }
+    if(c->identifer == mainSymbol)
         return resolveRoutineCall(c, env);
 
-    Object callee = env_get(c.identifer, c.line, env);
+    Object callee = env_get(c->identifer, c->line, env);
     if(callee.type == OBJECT_ROUTINE)
         return resolveRoutineCall(c, env);
     else
         return resolveContainerCall(c, env);
 }
 
-static Object resolveReference(Reference ref, Environment *env){
-    Object o = resolveExpression(ref.containerName, env);
+static Object memberGet(char *name, int line, MemberCache *cache, Instance *ins){
+    Environment *insEnv = (Environment *)ins->environment;
+    Object *o = env_member(name, ins->name, cache, insEnv);
+    if(o != NULL)
+        return *o;
+    return env_get(name, line, insEnv);
+}
+
+// Chains of plain member names are followed through the inline caches,
+// anything else is evaluated inside the instance
+static Object resolveMember(Reference *ref, Instance *ins){
+    Expression *mem = ref->member;
+    if(mem->type == EXPR_VARIABLE)
+        return memberGet(mem->variable.name, mem->variable.line, &ref->cache, ins);
+    if(mem->type == EXPR_REFERENCE && mem->referenceExpression.containerName->type == EXPR_VARIABLE){
+        Variable v = mem->referenceExpression.containerName->variable;
+        Object o = memberGet(v.name, v.line, &ref->cache, ins);
+        if(o.type != OBJECT_INSTANCE){
+            printf(runtime_error("Invalid member reference!"), mem->referenceExpression.line);
+            stop();
+        }
+        return resolveMember(&mem->referenceExpression, o.instance);
+    }
+    Object instance = {.instance = ins, .type = OBJECT_INSTANCE};
+    gc_push_root(instance);
+    Object result = resolveExpression(mem, (Environment *)ins->environment);
+    gc_pop_root();
+    return result;
+}
+
+static Object resolveReference(Reference *ref, Environment *env){
+    Object o = resolveExpression(ref->containerName, env);
     if(o.type != OBJECT_INSTANCE){
-        printf(runtime_error("Invalid member reference!"), ref.line);
+        printf(runtime_error("Invalid member reference!"), ref->line);
         stop();
     }
-    return resolveExpression(ref.member, (Environment *)o.instance->environment);
+    return resolveMember(ref, o.instance);
 }
 
 static Object resolveExpression(Expression* expression, Environment *env){
@@ -382,9 +382,9 @@ static Object resolveExpression(Expression* expression, Environment *env){
         case EXPR_LITERAL:
             return fromLiteral(expression->literal);
         case EXPR_BINARY:
-            return resolveBinary(expression->binary, env);
+            return resolveBinary(&expression->binary, env);
         case EXPR_LOGICAL:
-            return resolveLogical(expression->logical, env);
+            return resolveLogical(&expression->logical, env);
         case EXPR_NONE:
             return nullObject;
         case EXPR_VARIABLE:
@@ -392,78 +392,9 @@ static Object resolveExpression(Expression* expression, Environment *env){
         case EXPR_ARRAY:
             return resolveArray(expression->arrayExpression, env);
         case EXPR_CALL:
-            return resolveCall(expression->callExpression, env);
+            return resolveCall(&expression->callExpression, env);
         case EXPR_REFERENCE:
-            return resolveReference(expression->referenceExpression, env);
-    }
-}
-
-static void printString(const char *s){
-    int i = 0, len = strlen(s);
-    //printf("\nPrinting : %s", s);
-    while(i < len){
-        if(s[i] == '\\' && i < (len - 1)){
-            if(s[i+1] == 'n'){
-                putchar('\n');
-                i++;
-            }
-            else if(s[i+1] == 't'){
-                putchar('\t');
-                i++;
-            }
-            else if(s[i+1] == '"'){
-                putchar('"');
-                i++;
-            }
-            else
-                putchar('\\');
-        }
-        else
-            putchar(s[i]);
-        i++;
-    }
-}
-
-static void printLiteral(Literal result){
-    switch(result.type){
-        case LIT_NULL:
-            printf("Null");
-            break;
-        case LIT_LOGICAL:
-            printf("%s", result.lVal == 0 ? "False" : "True");
-            break;
-        case LIT_DOUBLE:
-            printf("%g", result.dVal);
-            break;
-        case LIT_INT:
-            printf("%ld", result.iVal);
-            break;
-        case LIT_STRING:
-            printString(result.sVal);
-            break;
-    }
-}
-
-static void printObject(Object o){ 
-    switch(o.type){
-        case OBJECT_ARRAY:
-            printf("<array of %d>", o.arr.count);
-            break;
-        case OBJECT_CONTAINER:
-            printf("<container %s>", o.container.name);
-            break;
-        case OBJECT_INSTANCE:
-            printf("<instance of container %s>", o.instance->name);
-            break;
-        case OBJECT_ROUTINE:
-            printf("<routine %s>", o.routine.name);
-            break;
-        case OBJECT_NULL:
-            printf("Null");
-            break;
-        case OBJECT_LITERAL:
-            printLiteral(o.literal);
-            break;
+            return resolveReference(&expression->referenceExpression, env);
     }
 }
 
@@ -477,14 +408,14 @@ static Object executePrint(Print p, Environment *env){
     return nullObject;
 }
 
-static Object executeStatement(Statement s, Environment *env);
+static Object executeStatement(Statement *s, Environment *env);
 
 static Object executeBlock(Block b, Environment *env){
     //debug("Executing block statement");
     int num = 0;
     Object retl = nullObject;
     while(num < b.numStatements){
-        retl = executeStatement(b.statements[num], env);
+        retl = executeStatement(&b.statements[num], env);
         if(brk || ret)
             break;
         num++;
@@ -518,6 +449,7 @@ static Object executeWhile(While w, Environment *env){
     }
     Object retl = nullObject;
     while(cond.lVal){
+        gc_safepoint();
         retl = executeBlock(w.body, env);
         if(brk){
             brk = 0;
@@ -533,54 +465,69 @@ static Object executeWhile(While w, Environment *env){
 static void write_array(Expression *id, Expression *initializerExpression, Environment *resEnv, 
         Environment *writeEnv, int line){
     Literal index = resolveLiteral(id->arrayExpression.index, line, resEnv);
-    if(index.type != LIT_INT){
-        printf(runtime_error("Array index must be an integer!"), line);
-        stop();
-    }
-    Object get = env_get(id->arrayExpression.identifier, line, writeEnv);
-    if(get.type == OBJECT_LITERAL && get.literal.type == LIT_STRING){
-        Literal rep = resolveLiteral(initializerExpression, line, resEnv);
-        if(index.lVal < 1){
-            printf(runtime_error("String index must be positive!"), line);
-            stop();
-        }
-        if(rep.type != LIT_STRING){
-            printf(runtime_error("Bad assignment to a string!"), line);
-            stop();
-        }
-        if(strlen(rep.sVal) > 1)
-            printf(warning("[Line %d] Ignoring extra characters while assignment!"), line);
-        get.literal.sVal[index.lVal - 1] = rep.sVal[0];
-    }
-    else
-        env_arr_put(id->arrayExpression.identifier, line, index.iVal, 
-                resolveExpression(initializerExpression, resEnv), writeEnv);
+    checkIndex(index, line);
+    Object value = resolveExpression(initializerExpression, resEnv);
+    writeIndex(env_lookup(id->arrayExpression.identifier, writeEnv), id->arrayExpression.identifier,
+            index, value, line);
 }
 
 static void write_ref(Expression *id, Expression *init, Environment *resEnv, 
-        Environment *writeEnv, int line){ 
-    Object ref = resolveExpression(id->referenceExpression.containerName, writeEnv);
+        Environment *writeEnv, int line);
+
+static Instance* refInstance(Object ref, int line){
     if(ref.type != OBJECT_INSTANCE){
         printf(runtime_error("Referenced item is not an instance of a container!"), line);
         stop();
     }
-    Set s;
-    Expression *mem = id->referenceExpression.member;
+    return ref.instance;
+}
+
+static void write_member(Reference *ref, Instance *ins, Expression *init, Environment *resEnv, int line){
+    Environment *insEnv = (Environment *)ins->environment;
+    Expression *mem = ref->member;
+    Object instance = {.instance = ins, .type = OBJECT_INSTANCE};
+    gc_push_root(instance); // the initializer may drop the last reference
     if(mem->type == EXPR_ARRAY){
-        write_array(mem, init, resEnv, (Environment *)ref.instance->environment, line);
+        write_array(mem, init, resEnv, insEnv, line);
     }
     else if(mem->type == EXPR_VARIABLE){
         Object value = resolveExpression(init, resEnv);
-        env_put(mem->variable.name, s.line, value, (Environment *)ref.instance->environment);
+        Object *slot = env_member(mem->variable.name, ins->name, &ref->cache, insEnv);
+        if(slot != NULL)
+            slot_put(slot, mem->variable.name, line, value);
+        else
+            env_put(mem->variable.name, line, value, insEnv);
     }
     else if(mem->type == EXPR_REFERENCE){
-        write_ref(mem, init, resEnv, (Environment *)ref.instance->environment, line);
+        Expression *container = mem->referenceExpression.containerName;
+        if(container->type == EXPR_VARIABLE){
+            Object inner = memberGet(container->variable.name, container->variable.line, &ref->cache, ins);
+            write_member(&mem->referenceExpression, refInstance(inner, line), init, resEnv, line);
+        }
+        else
+            write_ref(mem, init, resEnv, insEnv, line);
     }
     else{
         printf(runtime_error("Bad member access for container type '%s'"), 
-                s.line, ref.instance->name);
+                line, ins->name);
         stop();
     }
+    gc_pop_root();
+}
+
+static void write_ref(Expression *id, Expression *init, Environment *resEnv, 
+        Environment *writeEnv, int line){ 
+    Object ref = resolveExpression(id->referenceExpression.containerName, writeEnv);
+    write_member(&id->referenceExpression, refInstance(ref, line), init, resEnv, line);
+}
+
+// Set s = s + a + b marked by the optimizer : a, then b, is appended to s
+static void executeAppend(Expression *expr, char *name, Environment *env){
+    if(expr->type != EXPR_BINARY)
+        return;
+    executeAppend(expr->binary.left, name, env);
+    Object value = resolveExpression(expr->binary.right, env);
+    appendTo(env_lookup(name, env), name, value, expr->line);
 }
 
 static Object executeSet(Set s, Environment *env){
@@ -589,7 +536,9 @@ static Object executeSet(Set s, Environment *env){
     while(i < s.count){
         Expression *id = s.initializers[i].identifer;
         Expression *init = s.initializers[i].initializerExpression;
-        if(id->type == EXPR_VARIABLE)
+        if(s.initializers[i].append)
+            executeAppend(init, id->variable.name, env);
+        else if(id->type == EXPR_VARIABLE)
             env_put(id->variable.name, s.line, resolveExpression(init, env), env);
         else if(id->type == EXPR_ARRAY){
             write_array(id, init, env, env, s.line);
@@ -617,7 +566,7 @@ static Object executeArray(ArrayInit ai, Environment *env){
             stop();
             return nullObject;
         }
-        env_arr_new(iden->arrayExpression.identifier, ai.line, init.iVal, env);
+        env_arr_new(iden->arrayExpression.identifier, ai.line, init.iVal, ai.datatypes[i], env);
         i++;
     }
     return nullObject;
@@ -636,13 +585,13 @@ static Object executeInput(InputStatement is, Environment *env){
                     char *ide = in.identifer;
                     switch(in.datatype){
                         case INPUT_ANY:
-                            env_put(ide, is.line, fromLiteral(getString(is.line)), env);
+                            env_put(ide, is.line, fromLiteral(getString()), env);
                             break;
                         case INPUT_FLOAT:
-                            env_put(ide, is.line, fromLiteral(getFloat(is.line)), env);
+                            env_put(ide, is.line, fromLiteral(getFloat()), env);
                             break;
                         case INPUT_INT:
-                            env_put(ide, is.line, fromLiteral(getInt(is.line)), env);
+                            env_put(ide, is.line, fromLiteral(getInt()), env);
                             break;
                     }
                 }
@@ -671,13 +620,13 @@ static Object executeBegin(){
     return nullObject;
 }
 
-static Object registerRoutine(Routine r){
-    env_routine_put(r, r.line, globalEnv);
+static Object registerRoutine(Routine *r){
+    env_routine_put(r, r->line, globalEnv);
     return nullObject;
 }
 
-static Object registerContainer(Container c){
-    env_container_put(c, c.line, globalEnv);
+static Object registerContainer(Container *c){
+    env_container_put(c, c->line, globalEnv);
     return nullObject;
 }
 
@@ -687,12 +636,8 @@ static Object executeCall(CallStatement cs, Environment *env){
         stop();
     }
     else{
-        Object o = resolveCall(cs.callee->callExpression, env);
-        if(o.type != OBJECT_NULL)
-            printf(warning("[Line %d] Ignoring return value!"), cs.line);
-        if(o.type == OBJECT_INSTANCE){
-            gc_obj(o);
-        }
+        Object o = resolveCall(&cs.callee->callExpression, env);
+        discardResult(o, cs.line);
     }
     return nullObject;
 }
@@ -702,29 +647,24 @@ static Object executeReturn(ReturnStatement rs, Environment *env){
     if(rs.value != NULL)
         retl = resolveExpression(rs.value,  env);
     //    printf(debug("Returing object of type %d"), retl.type);
-    if(retl.type == OBJECT_INSTANCE){
-        retl.instance->fromReturn = 1;
-        //        printf(debug("Incrementing ref to %d of %s#%d\n"), retl.instance->refCount,
-        //                retl.instance->name, retl.instance->insCount);
-    }
     ret = 1;
     return retl;
 }
 
-static Object executeStatement(Statement s, Environment *env){
-    switch(s.type){
+static Object executeStatement(Statement *s, Environment *env){
+    switch(s->type){
         case STATEMENT_PRINT:
-            return executePrint(s.printStatement, env);
+            return executePrint(s->printStatement, env);
         case STATEMENT_IF:
-            return executeIf(s.ifStatement, env);
+            return executeIf(s->ifStatement, env);
         case STATEMENT_WHILE:
-            return executeWhile(s.whileStatement, env);
+            return executeWhile(s->whileStatement, env);
         case STATEMENT_SET:
-            return executeSet(s.setStatement, env);
+            return executeSet(s->setStatement, env);
         case STATEMENT_ARRAY:
-            return executeArray(s.arrayStatement, env);
+            return executeArray(s->arrayStatement, env);
         case STATEMENT_INPUT:
-            return executeInput(s.inputStatement, env);
+            return executeInput(s->inputStatement, env);
         case STATEMENT_BREAK:
             return executeBreak();
         case STATEMENT_END:
@@ -734,38 +674,70 @@ static Object executeStatement(Statement s, Environment *env){
             //       case STATEMENT_DO:
             //           executeDo(s.)
         case STATEMENT_ROUTINE:
-            return registerRoutine(s.routine);
+            return registerRoutine(&s->routine);
         case STATEMENT_CONTAINER:
-            return registerContainer(s.container);
+            return registerContainer(&s->container);
         case STATEMENT_CALL:
-            return executeCall(s.callStatement, env);
+            return executeCall(s->callStatement, env);
         case STATEMENT_NOOP:
             break;
         case STATEMENT_RETURN:
-            return executeReturn(s.returnStatement, env);
+            return executeReturn(s->returnStatement, env);
         default:
             break;
     }
     return nullObject;
 }
 
-void interpret(Code c){
+static void walk(Code c){
     int i = 0;
-    globalEnv = env_new(NULL);
-    register_native(globalEnv);
     while(i < c.count){
-        executeStatement(c.parts[i], globalEnv);
+        executeStatement(&c.parts[i], globalEnv);
         i++;
     }
     Call call;
     call.argCount = 0;
-    call.identifer = strdup("Main");
+    call.identifer = mainSymbol;
+    call.type = CALL_UNBOUND;
     call.arguments = NULL;
     call.line = 0;
     clock_t start = clock();
-    resolveCall(call, globalEnv);
+    resolveCall(&call, globalEnv);
     clock_t end = clock();
     printf(debug("[Interpreter] Execution time : %gms"), (double)(end-start)/CLOCKS_PER_SEC);
+}
+
+static void run(Code c){
+    Chunk *script = compile(c);
+    if(hasCompileError()){
+        printf(error("%d errors occured while compiling. Correct them and try to run again.\n"), hasCompileError());
+        stop();
+    }
+    vm_init(globalEnv);
+    vm_execute(script);
+    clock_t start = clock();
+    vm_call_main();
+    clock_t end = clock();
+    printf(debug("[Interpreter] Execution time : %gms"), (double)(end-start)/CLOCKS_PER_SEC);
+    chunk_free(script);
+}
+
+Object call_back(Routine *r, Object *args, int line){
+    if(walking)
+        return walkCall(r, args, line);
+    return vm_call(r, args, line);
+}
+
+void interpret(Code c, int treeWalk){
+    globalEnv = env_new(NULL);
+    gc_init(globalEnv);
+    mainSymbol = intern("Main");
+    register_native(globalEnv);
+    walking = treeWalk;
+    if(treeWalk)
+        walk(c);
+    else
+        run(c);
     unload_all();
     env_free(globalEnv);
 }
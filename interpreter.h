@@ -3,20 +3,28 @@
 
 #include "stmt.h"
 
-void interpret(Code c);
+void interpret(Code c, int treeWalk);
 void stop();
 
 typedef struct Object Object;
 
+#pragma pack(push, 4)
 typedef struct{
-    int count;
-    Object *values;
+    union{
+        Object *values;
+        long *longs;     // ARRAY_INT
+        double *doubles; // ARRAY_FLOAT
+    };
+    int count : 30;
+    unsigned int datatype : 2; // ArrayDataType
 } Array;
+#pragma pack(pop)
+
+#define ARRAY_MAX_COUNT ((1L << 29) - 1) // largest count that fits
 
+// Owned by the collector, see gc.h
 typedef struct{
-    int refCount;
     char *name;
-    int fromReturn;
     int insCount;
     void *environment;
 } Instance;
@@ -27,21 +35,30 @@ typedef enum{
     OBJECT_ARRAY,
     OBJECT_ROUTINE,
     OBJECT_CONTAINER,
-    OBJECT_INSTANCE
+    OBJECT_INSTANCE,
+    OBJECT_UNDEFINED
 } ObjectType;
 
+// 16 bytes : a 12 byte payload followed by the tag. Routines and
+// containers live in the parsed code and are only pointed to.
+#pragma pack(push, 4)
 struct Object{
-    ObjectType type;
     union{
         Literal literal;
         Array arr;
-        Routine routine;
-        Container container;
+        Routine *routine;
+        Container *container;
         Instance* instance;
     };
+    ObjectType type;
 };
+#pragma pack(pop)
+
+// Calls r for a native, in whichever engine runs the script
+Object call_back(Routine *r, Object *args, int line);
 
-static Literal nullLiteral = {0, LIT_NULL, {0}};
-static Object nullObject = {OBJECT_NULL, {{0, LIT_NULL, {0}}}};
+static Literal nullLiteral = {.type = LIT_NULL};
+static Object nullObject = {.literal = {.type = LIT_NULL}, .type = OBJECT_NULL};
+extern Object undefinedObject; // unset local slots, see vm.c
 
 #endif
@@ -1,9 +1,11 @@
 #include <stdio.h>
+#include <string.h>
 
 #include "allocator.h"
 #include "expr.h"
 #include "io.h"
 #include "display.h"
+#include "gc.h"
 
 static char* readString(){
     char *ret = NULL;
@@ -20,10 +22,12 @@ static char* readString(){
     return ret;
 }
 
-Literal getString(int line){
+Literal getString(){
     char *s = readString();
-    Literal ret = {line, LIT_STRING, {0}};
-    ret.sVal = s;
+    Literal ret = {.type = LIT_STRING};
+    ret.sVal = gc_string(strlen(s));
+    strcpy(ret.sVal, s);
+    memfree(s);
     return ret;
 }
 
@@ -49,7 +53,7 @@ static int isInt(char *s){
     return 1;
 }
 
-Literal getInt(int line){
+Literal getInt(){
     char *s = readString();
     while(!isInt(s)){
         printf(warning("[Input Error] Not an integer : %s!\n[Re-Input] "), s);
@@ -58,7 +62,7 @@ Literal getInt(int line){
     long l = 0;
     sscanf(s, "%ld", &l);
     memfree(s);
-    Literal lit = {line, LIT_INT, {0}};
+    Literal lit = {.type = LIT_INT};
     lit.iVal = l;
     return lit;
 }
@@ -83,7 +87,7 @@ static int isNumber(char *s){
     return 1;
 }
 
-Literal getFloat(int line){
+Literal getFloat(){
     char *s = readString();
     while(!isNumber(s)){
         printf(warning("[Input Error] Not a number : %s!\n[Re-Input] "), s);
@@ -92,7 +96,7 @@ Literal getFloat(int line){
     double d = 0;
     sscanf(s, "%lf", &d);
     memfree(s);
-    Literal lit = {line, LIT_DOUBLE, {0}};
+    Literal lit = {.type = LIT_DOUBLE};
     lit.dVal = d;
     return lit;
 }
@@ -1,5 +1,6 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "scanner.h"
 #include "parser.h"
@@ -8,6 +9,9 @@
 #include "allocator.h"
 #include "interpreter.h"
 #include "preprocessor.h"
+#include "resolver.h"
+#include "optimizer.h"
+#include "gc.h"
 
 static void p(const char* name, size_t size){
     printf("\n%s : %lu bytes", name, size);
@@ -20,6 +24,17 @@ static void printSize(){
 
 int main(int argc, char **argv){
 //    printSize();
+    int treeWalk = 0;
+    while(argc > 2 && strncmp(argv[1], "--", 2) == 0){
+        if(strcmp(argv[1], "--tree-walk") == 0) // bypass the bytecode vm
+            treeWalk = 1;
+        else if(!gc_option(argv[1])){
+            printf(error("Bad option %s!"), argv[1]);
+            return 2;
+        }
+        argc--;
+        argv++;
+    }
     if(argc != 2)
         return 2;
     FILE *f = fopen(argv[1], "rb");
@@ -51,9 +66,18 @@ int main(int argc, char **argv){
         return 1;
     }
 
-    freeList(tokens);
-    interpret(all);
+    freeList();
+    resolve(all);
+    if(hasLinkError()){
+        printf(error("%d errors occured while linking. Correct them and try to run again.\n"), hasLinkError());
+        memfree_all();
+        return 1;
+    }
+    optimize(all);
+    interpret(all, treeWalk);
 
+//    memstats();
+    freeCode();
     memfree_all();
 
     printf("\n");
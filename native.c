@@ -10,14 +10,43 @@
 #include "display.h"
 #include "foreign_interface.h"
 #include "native.h"
+#include "symbol.h"
+#include "gc.h"
 
 typedef struct{
     char *name;
-    void *handle;
+    void *handle; // NULL until a routine is first looked up in it
+    ForeignSignature *table; // NULL if it has no table
 } Library;
 
+// Modules compiled into the interpreter, searched before any library
+typedef struct{
+    const char *name;
+    ForeignSignature *table;
+} Module;
+
+extern ForeignSignature MathTable[];
+
+static const Module modules[] = {
+    {"Math", MathTable},
+    {NULL, NULL}
+};
+
 static Library *libraries = NULL;
 static int libCount = 0;
+// Unloading a library reorders the rest, so it starts a new generation
+// and every foreign routine looks its symbol up again
+static int generation = 1;
+
+static int isModule(const char *name){
+    int i = 0;
+    while(modules[i].name != NULL){
+        if(strcmp(modules[i].name, name) == 0)
+            return 1;
+        i++;
+    }
+    return 0;
+}
 
 static int hasLib(char *name){
     int i = 0;
@@ -29,48 +58,65 @@ static int hasLib(char *name){
     return 0;
 }
 
-static Object load_library(int c, Environment *env, char *s){
-    if(env != NULL)
-        s = get_string("x", c, env);
+// Only recorded here, the library is opened by bind once a routine
+// is not found in the modules or the libraries opened before it
+static Object load_library(int line, Environment *env){
+    char *s = get_string("x", line, env);
 
-    if(hasLib(s))
+    if(isModule(s) || hasLib(s))
         return nullObject;
 
-    void *lib = dlopen(s, RTLD_LAZY);
-    if(!lib){
-        printf(runtime_error("%s"), c, dlerror());
-        stop();
-    }
     libCount++;
     libraries = (Library *)reallocate(libraries, sizeof(Library) * libCount);
-    libraries[libCount - 1].name = s;
-    libraries[libCount - 1].handle = lib;
+    libraries[libCount - 1].name = intern(s); // s may be collected
+    libraries[libCount - 1].handle = NULL;
+    libraries[libCount - 1].table = NULL;
 
     return nullObject;
 }
 
+static void open_library(Library *lib, int line){
+    lib->handle = dlopen(lib->name, RTLD_LAZY);
+    if(lib->handle == NULL){
+        printf(runtime_error("%s"), line, dlerror());
+        stop();
+    }
+    lib->table = (ForeignSignature *)dlsym(lib->handle, "ForeignTable");
+    dlerror();
+}
+
+static void close_library(Library *lib){
+    char *err = NULL;
+    if(lib->handle == NULL)
+        return;
+    dlclose(lib->handle);
+    if((err = dlerror()) != NULL)
+        printf(warning("%s"), err);
+}
+
 void unload_all(){
     int i = 0;
-    char *err = NULL;
     while(i < libCount){
-        dlclose(libraries[i].handle);
-        if((err = dlerror()) != NULL)
-            printf(warning("%s"), err);
+        close_library(&libraries[i]);
         i++;
     }
     memfree(libraries);
     libCount = 0;
     libraries = NULL;
+    generation++;
 }
 
 static Object unload_library(int c, Environment *env){
     char *s = get_string("x", c, env);
 
+    if(isModule(s)){
+        printf(warning("Module '%s' is built in and cannot be unloaded!"), s);
+        return nullObject;
+    }
     if(!hasLib(s)){
         printf(warning("Library '%s' is not loaded!"), s);
         return nullObject;
     }
-    char *err = NULL;
     if(libCount == 1){
         unload_all();
         return nullObject;
@@ -79,63 +125,238 @@ static Object unload_library(int c, Environment *env){
     int i = 0;
     while(i < libCount){
         if(strcmp(libraries[i].name, s) == 0){
-            dlclose(libraries[i].handle);
-            if((err = dlerror())!=NULL){
-                printf(warning("%s"), err);
-            }
-            libraries[i].name = libraries[libCount - 1].name;
-            libraries[i].handle = libraries[libCount - 1].handle;
+            close_library(&libraries[i]);
+            libraries[i] = libraries[libCount - 1];
             break;
         }
         i++;
     }
     libCount--;
     libraries = (Library *)reallocate(libraries, sizeof(Library) * libCount);
+    generation++;
     return nullObject;
 }
 
-static void* get_func(char *identifer, int line){
+// Typed signatures are kept as the arity in the low bits and flags
+#define SIG_TYPED 16
+#define SIG_RETURNS_DOUBLE 8
+#define SIG_TAKES_DOUBLE 4
+#define SIG_ARITY 3
+
+static int typeOf(const char **s){
+    if(strncmp(*s, "double", 6) == 0){
+        *s += 6;
+        return SIG_RETURNS_DOUBLE;
+    }
+    if(strncmp(*s, "long", 4) == 0){
+        *s += 4;
+        return 0;
+    }
+    return -1;
+}
+
+// Returns -1 for anything outside what call_typed can pass
+static int parseSignature(const char *s){
+    int result = typeOf(&s), arity = 0, argType = -1;
+    if(result == -1 || *s++ != '(')
+        return -1;
+    while(*s != ')'){
+        int type = typeOf(&s);
+        if(type == -1 || (argType != -1 && type != argType) || arity == FOREIGN_MAX_ARGS)
+            return -1;
+        argType = type;
+        arity++;
+        if(*s == ',')
+            s++;
+        else if(*s != ')')
+            return -1;
+    }
+    if(s[1] != '\0')
+        return -1;
+    return SIG_TYPED | result | (argType == SIG_RETURNS_DOUBLE ? SIG_TAKES_DOUBLE : 0) | arity;
+}
+
+static ForeignSignature* findEntry(ForeignSignature *table, char *identifer){
+    while(table != NULL && table->name != NULL){
+        if(strcmp(table->name, identifer) == 0)
+            return table;
+        table++;
+    }
+    return NULL;
+}
+
+static void bindEntry(Routine *r, ForeignSignature *fs, int line){
+    r->foreign = fs->function;
+    if(fs->signature == NULL){
+        r->signature = 0;
+        return;
+    }
+    r->signature = parseSignature(fs->signature);
+    if(r->signature == -1){
+        printf(runtime_error("Unsupported signature '%s' of foreign routine %s!"), line, fs->signature, r->name);
+        stop();
+    }
+    if((r->signature & SIG_ARITY) != r->arity){
+        printf(runtime_error("Foreign routine %s is declared with %d arguments, but its signature is '%s'!"),
+                line, r->name, r->arity, fs->signature);
+        stop();
+    }
+}
+
+static void bind(Routine *r, int line){
+    ForeignSignature *fs = NULL;
     int i = 0;
+    r->binding = generation;
+    while(modules[i].name != NULL){
+        if((fs = findEntry(modules[i].table, r->name)) != NULL){
+            bindEntry(r, fs, line);
+            return;
+        }
+        i++;
+    }
     if(libCount == 0){
-        printf(runtime_error("Unable to call %s : No libraries loaded!"), line, identifer);
+        printf(runtime_error("Unable to call %s : No libraries loaded!"), line, r->name);
         stop();
     }
+    i = 0;
     while(i < libCount){
-        void *f = dlsym(libraries[i].handle, identifer);
-        if(dlerror() == NULL)
-            return f;
+        if(libraries[i].handle == NULL)
+            open_library(&libraries[i], line);
+        if((fs = findEntry(libraries[i].table, r->name)) != NULL){
+            bindEntry(r, fs, line);
+            return;
+        }
+        r->foreign = dlsym(libraries[i].handle, r->name);
+        if(dlerror() == NULL){
+            r->signature = 0;
+            return;
+        }
         i++;
     }
-    printf(runtime_error("Foreign routine '%s' not found in loaded libraries!"), line, identifer);
+    printf(runtime_error("Foreign routine '%s' not found in loaded libraries!"), line, r->name);
     stop();
-    return NULL;
+}
+
+// Whole strings are handed back as they are, the shared bit makes a
+// later write copy them. Anything shorter is copied once, since the
+// characters of a string value must end in a terminator right after
+// its own header.
+static Object substring(int line, Environment *env){
+    char *s = get_string("string", line, env);
+    long start = get_long("start", line, env), length = get_long("length", line, env);
+    long size = str_length(s);
+    Object o;
+    if(start < 1 || start > size + 1){
+        printf(runtime_error("Substring start out of range [%ld]!"), line, start);
+        stop();
+    }
+    if(length < 0 || start - 1 + length > size){
+        printf(runtime_error("Substring length out of range [%ld]!"), line, length);
+        stop();
+    }
+    o.type = OBJECT_LITERAL;
+    o.literal.type = LIT_STRING;
+    if(length == size){
+        str_header(s)->shared = 1;
+        o.literal.sVal = s;
+        return o;
+    }
+    o.literal.sVal = gc_string(length);
+    memcpy(o.literal.sVal, s + start - 1, length);
+    return o;
 }
 
 typedef Object (*handler)(int line, Environment *env);
 
-static Object run_native(Call c, Environment *env){
-    handler fhandle = (handler)get_func(c.identifer, c.line);
-    return fhandle(c.line, env);
+// Foreign routines keep the symbol they were bound to on their first
+// call, until the generation changes. Builtins are bound for good.
+#define BOUND_BUILTIN -1
+
+static Routine builtins[3];
+
+Object handle_native(Routine *r, int line, Environment *env){
+    if(r->binding != generation && r->binding != BOUND_BUILTIN)
+        bind(r, line);
+    int mark = foreign_mark();
+    Object result = ((handler)r->foreign)(line, env);
+    foreign_release(mark);
+    return result;
 }
 
-Object handle_native(Call c, Environment *env){
-    char *fname = c.identifer;
-    int i = 0;
-    if(strcmp(fname, "LoadLibrary") == 0)
-        return load_library(c.line, env, NULL);
-    else if(strcmp(fname, "UnloadLibrary") == 0)
-        return unload_library(c.line, env);
-    else
-        return run_native(c, env);
+int native_typed(Routine *r, int line){
+    if(r->binding != generation && r->binding != BOUND_BUILTIN)
+        bind(r, line);
+    return r->signature != 0;
 }
 
-static Routine get_routine(char *identifer, int arity){
+static double doubleArg(Object o, int line){
+    if(o.type == OBJECT_LITERAL && o.literal.type == LIT_DOUBLE)
+        return o.literal.dVal;
+    if(o.type == OBJECT_LITERAL && o.literal.type == LIT_INT)
+        return o.literal.iVal;
+    printf(runtime_error("Expected numeric value!"), line);
+    stop();
+    return 0;
+}
+
+static long longArg(Object o, int line){
+    if(o.type != OBJECT_LITERAL || o.literal.type != LIT_INT){
+        printf(runtime_error("Expected integer value!"), line);
+        stop();
+    }
+    return o.literal.iVal;
+}
+
+#define TYPED_CALL(name, R, A) \
+    static R name(void *f, int arity, A *a){ \
+        switch(arity){ \
+            case 0: return ((R (*)(void))f)(); \
+            case 1: return ((R (*)(A))f)(a[0]); \
+            case 2: return ((R (*)(A, A))f)(a[0], a[1]); \
+            default: return ((R (*)(A, A, A))f)(a[0], a[1], a[2]); \
+        } \
+    }
+
+TYPED_CALL(doubleOfDoubles, double, double)
+TYPED_CALL(doubleOfLongs, double, long)
+TYPED_CALL(longOfDoubles, long, double)
+TYPED_CALL(longOfLongs, long, long)
+
+Object call_typed(Routine *r, Object *args, int line){
+    int i = 0, arity = r->signature & SIG_ARITY;
+    if(r->signature & SIG_TAKES_DOUBLE){
+        double a[FOREIGN_MAX_ARGS];
+        while(i < arity){
+            a[i] = doubleArg(args[i], line);
+            i++;
+        }
+        if(r->signature & SIG_RETURNS_DOUBLE)
+            return fromDouble(doubleOfDoubles(r->foreign, arity, a));
+        return fromLong(longOfDoubles(r->foreign, arity, a));
+    }
+    long a[FOREIGN_MAX_ARGS];
+    while(i < arity){
+        a[i] = longArg(args[i], line);
+        i++;
+    }
+    if(r->signature & SIG_RETURNS_DOUBLE)
+        return fromDouble(doubleOfLongs(r->foreign, arity, a));
+    return fromLong(longOfLongs(r->foreign, arity, a));
+}
+
+static Routine make_routine(char *identifer, int arity){
     Routine r;
     r.isNative = 1;
     r.name = identifer;
     r.arity = arity;
     r.line = 0;
     r.arguments = NULL;
+    r.localCount = 0;
+    r.locals = NULL;
+    r.chunk = NULL;
+    r.foreign = NULL;
+    r.binding = 0;
+    r.signature = 0;
 
     return r;
 }
@@ -146,20 +367,83 @@ static void add_argument(Routine *r, char *argName){
     r->arguments[r->arity - 1] = argName;
 }
 
-static Routine getSingleArgRoutine(char *name){
-    Routine r = get_routine(name, 0);
-    add_argument(&r, "x");
+static Routine get_builtin(char *name, handler h){
+    Routine r = make_routine(intern(name), 0);
+    r.foreign = (void *)h;
+    r.binding = BOUND_BUILTIN;
     return r;
 }
 
+// Globals created by register_native, visible to the resolver before they exist
+static const char *nativeGlobals[] = {
+    "LoadLibrary",
+    "UnloadLibrary",
+    "Substring",
+    "Math_Pi",
+    "Math_E",
+    NULL
+};
+
+int is_native_global(const char *name){
+    int i = 0;
+    while(nativeGlobals[i] != NULL){
+        if(strcmp(nativeGlobals[i], name) == 0)
+            return 1;
+        i++;
+    }
+    return 0;
+}
+
+// Values of the constants among nativeGlobals
+int native_constant(const char *name, Literal *value){
+    value->type = LIT_DOUBLE;
+    if(strcmp(name, "Math_Pi") == 0)
+        value->dVal = acos(-1.0);
+    else if(strcmp(name, "Math_E") == 0)
+        value->dVal = M_E;
+    else
+        return 0;
+    return 1;
+}
+
 static void define_cons(Environment *env){
-    env_put("Math_Pi", 0, fromDouble(acos(-1.0)), env);
-    env_put("Math_E", 0, fromDouble(M_E), env);
+    int i = 0;
+    Literal l;
+    while(nativeGlobals[i] != NULL){
+        if(native_constant(nativeGlobals[i], &l))
+            env_put(intern(nativeGlobals[i]), 0, fromDouble(l.dVal), env);
+        i++;
+    }
+}
+
+static void init_builtins(){
+    if(builtins[0].name != NULL)
+        return;
+    builtins[0] = get_builtin("LoadLibrary", load_library);
+    add_argument(&builtins[0], intern("x"));
+    builtins[1] = get_builtin("UnloadLibrary", unload_library);
+    add_argument(&builtins[1], intern("x"));
+    builtins[2] = get_builtin("Substring", substring);
+    add_argument(&builtins[2], intern("string"));
+    add_argument(&builtins[2], intern("start"));
+    add_argument(&builtins[2], intern("length"));
+}
+
+Routine* native_routine(char *name){
+    int i = 0;
+    init_builtins();
+    while(i < 3){
+        if(builtins[i].name == name)
+            return &builtins[i];
+        i++;
+    }
+    return NULL;
 }
 
 void register_native(Environment *env){
-    env_routine_put(getSingleArgRoutine("LoadLibrary"), 0, env);
-    env_routine_put(getSingleArgRoutine("UnloadLibrary"), 0, env);
+    init_builtins();
+    env_routine_put(&builtins[0], 0, env);
+    env_routine_put(&builtins[1], 0, env);
+    env_routine_put(&builtins[2], 0, env);
     define_cons(env);
-    load_library(0, NULL, "./libnmath.so");
 }
@@ -4,7 +4,15 @@
 #include "interpreter.h"
 #include "environment.h"
 
-Object handle_native(Call c, Environment *env);
+#define FOREIGN_MAX_ARGS 3
+
+Object handle_native(Routine *r, int line, Environment *env);
+// Whether r is called with unboxed arguments, binds it if needed
+int native_typed(Routine *r, int line);
+Object call_typed(Routine *r, Object *args, int line);
 void register_native(Environment *env);
 void unload_all();
+int is_native_global(const char *name);
+Routine* native_routine(char *name);
+int native_constant(const char *name, Literal *value);
 #endif
@@ -11,6 +11,11 @@ Routine Foreign Log(x)
 Routine Foreign Log10(x)
 Routine Foreign Exp(x)
 Routine Foreign Abs(x)
+Routine Foreign Integrate(f, a, b, n)
+Routine Foreign Sum(a)
+Routine Foreign Dot(a, b)
+Routine Foreign ScaleAdd(a, k, b)
+Routine Foreign SinAll(a)
 
 Routine Radian(x)
     Return (Math_Pi/180)*x
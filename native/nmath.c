@@ -1,54 +1,270 @@
 #include <math.h>
+#include <stddef.h>
+#include <stdio.h>
 
 #include "../foreign_interface.h"
 
-Object Sin(int i, Environment *env){
-    return fromDouble(sin(get_double("x", i, env)));
+// Kernels over whole arrays use AVX when the compiler targets it, else
+// SSE2, else plain loops. The v* macros hide which one.
+#if defined(__AVX__)
+#include <immintrin.h>
+typedef __m256d vec;
+#define LANES 4
+#define vload _mm256_loadu_pd
+#define vstore _mm256_storeu_pd
+#define vset _mm256_set1_pd
+#define vadd _mm256_add_pd
+#define vsub _mm256_sub_pd
+#define vmul _mm256_mul_pd
+#define vand _mm256_and_pd
+#define vandnot _mm256_andnot_pd
+#define vor _mm256_or_pd
+#define vxor _mm256_xor_pd
+#define vtrunc(x) _mm256_round_pd(x, _MM_FROUND_TO_ZERO | _MM_FROUND_NO_EXC)
+#define veq(a, b) _mm256_cmp_pd(a, b, _CMP_EQ_OQ)
+#define vle(a, b) _mm256_cmp_pd(a, b, _CMP_LE_OQ)
+#define vmask _mm256_movemask_pd
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+typedef __m128d vec;
+#define LANES 2
+#define vload _mm_loadu_pd
+#define vstore _mm_storeu_pd
+#define vset _mm_set1_pd
+#define vadd _mm_add_pd
+#define vsub _mm_sub_pd
+#define vmul _mm_mul_pd
+#define vand _mm_and_pd
+#define vandnot _mm_andnot_pd
+#define vor _mm_or_pd
+#define vxor _mm_xor_pd
+#define vtrunc(x) _mm_cvtepi32_pd(_mm_cvttpd_epi32(x)) // inputs stay below 2^31
+#define veq _mm_cmpeq_pd
+#define vle _mm_cmple_pd
+#define vmask _mm_movemask_pd
+#endif
+
+static double valueOf(Object o, int line){
+    if(o.type == OBJECT_LITERAL && o.literal.type == LIT_DOUBLE)
+        return o.literal.dVal;
+    if(o.type == OBJECT_LITERAL && o.literal.type == LIT_INT)
+        return o.literal.iVal;
+    printf(runtime_error("Integrand must return a numeric value!"), line);
+    stop();
+    return 0;
 }
 
-Object Cos(int i, Environment *env){
-    return fromDouble(cos(get_double("x", i, env)));
+static double at(Routine *f, double x, int line){
+    Object arg = fromDouble(x);
+    return valueOf(call_routine(f, line, 1, &arg), line);
 }
 
-Object Tan(int i, Environment *env){
-    return fromDouble(tan(get_double("x", i, env)));
+// Composite Simpson's rule over n intervals, rounded up to even
+static Object Integrate(int i, Environment *env){
+    Routine *f = get_routine("f", i, env);
+    double a = get_double("a", i, env), b = get_double("b", i, env);
+    long n = get_long("n", i, env), k = 1;
+    if(n < 1){
+        printf(runtime_error("Integrate needs at least one interval!"), i);
+        stop();
+    }
+    n += n % 2;
+    double h = (b - a) / n, sum = at(f, a, i) + at(f, b, i);
+    while(k < n){
+        sum += (k % 2 == 1 ? 4 : 2) * at(f, a + k * h, i);
+        k++;
+    }
+    return fromDouble(sum * h / 3);
 }
 
-Object ASin(int i, Environment *env){
-    return fromDouble(asin(get_double("x", i, env)));
+#ifdef LANES
+// Four accumulators, so consecutive adds do not wait on each other
+static double reduce(vec acc[4]){
+    double lanes[LANES], sum = 0;
+    vstore(lanes, vadd(vadd(acc[0], acc[1]), vadd(acc[2], acc[3])));
+    for(int l = 0; l < LANES; l++)
+        sum += lanes[l];
+    return sum;
 }
-Object ACos(int i, Environment *env){
-    return fromDouble(acos(get_double("x", i, env)));
+#endif
+
+static double sumOf(const double *a, long n){
+    double sum = 0;
+    long i = 0;
+#ifdef LANES
+    vec acc[4] = {vset(0), vset(0), vset(0), vset(0)};
+    while(i + 4 * LANES <= n){
+        for(int k = 0; k < 4; k++)
+            acc[k] = vadd(acc[k], vload(a + i + k * LANES));
+        i += 4 * LANES;
+    }
+    sum = reduce(acc);
+#endif
+    while(i < n){
+        sum += a[i];
+        i++;
+    }
+    return sum;
 }
 
-Object ATan(int i, Environment *env){
-    return fromDouble(atan(get_double("x", i, env)));
+static double dotOf(const double *a, const double *b, long n){
+    double sum = 0;
+    long i = 0;
+#ifdef LANES
+    vec acc[4] = {vset(0), vset(0), vset(0), vset(0)};
+    while(i + 4 * LANES <= n){
+        for(int k = 0; k < 4; k++)
+            acc[k] = vadd(acc[k], vmul(vload(a + i + k * LANES), vload(b + i + k * LANES)));
+        i += 4 * LANES;
+    }
+    sum = reduce(acc);
+#endif
+    while(i < n){
+        sum += a[i] * b[i];
+        i++;
+    }
+    return sum;
 }
 
-Object Sinh(int i, Environment *env){
-    return fromDouble(sinh(get_double("x", i, env)));
+static void scaleAdd(const double *a, double k, const double *b, double *out, long n){
+    long i = 0;
+#ifdef LANES
+    vec vk = vset(k);
+    while(i + LANES <= n){
+        vstore(out + i, vadd(vmul(vk, vload(a + i)), vload(b + i)));
+        i += LANES;
+    }
+#endif
+    while(i < n){
+        out[i] = k * a[i] + b[i];
+        i++;
+    }
 }
 
-Object Cosh(int i, Environment *env){
-    return fromDouble(cosh(get_double("x", i, env)));
+#ifdef LANES
+// The sine of Cephes : x is reduced by multiples of pi/4 in three parts,
+// then one of two polynomials is picked per lane by the octant. Lanes
+// beyond LOSS, or NaN, are left to libm.
+#define LOSS 1.073741824e9
+
+static vec polynomial(vec x, const double *c){
+    vec p = vset(c[0]);
+    for(int i = 1; i < 6; i++)
+        p = vadd(vmul(p, x), vset(c[i]));
+    return p;
 }
 
-Object Tanh(int i, Environment *env){
-    return fromDouble(tanh(get_double("x", i, env)));
+static vec sinVec(vec x){
+    static const double sincof[] = {
+        1.58962301576546568060E-10, -2.50507477628578072866E-8,
+        2.75573136213857245213E-6, -1.98412698295895385996E-4,
+        8.33333333332211858878E-3, -1.66666666666666307295E-1
+    };
+    static const double coscof[] = {
+        -1.13585365213876817300E-11, 2.08757008419747316778E-9,
+        -2.75573141792967388112E-7, 2.48015872888517045348E-5,
+        -1.38888888888730564116E-3, 4.16666666666665929218E-2
+    };
+    vec signBit = vset(-0.0), sign = vand(x, signBit), ax = vandnot(signBit, x);
+    vec y = vtrunc(vmul(ax, vset(1.27323954473516268615)));
+    y = vadd(y, vsub(y, vmul(vset(2), vtrunc(vmul(y, vset(0.5)))))); // to even
+    vec octant = vsub(y, vmul(vset(8), vtrunc(vmul(y, vset(0.125)))));
+    vec z = vsub(vsub(vsub(ax, vmul(y, vset(7.85398125648498535156E-1))),
+                vmul(y, vset(3.77489470793079817668E-8))), vmul(y, vset(2.69515142907905952645E-15)));
+    vec zz = vmul(z, z);
+    vec s = vadd(z, vmul(vmul(z, zz), polynomial(zz, sincof)));
+    vec c = vadd(vsub(vset(1), vmul(zz, vset(0.5))), vmul(vmul(zz, zz), polynomial(zz, coscof)));
+    vec useCos = vor(veq(octant, vset(2)), veq(octant, vset(6)));
+    vec r = vor(vand(useCos, c), vandnot(useCos, s));
+    sign = vxor(sign, vand(vle(vset(4), octant), signBit));
+    return vxor(r, sign);
 }
+#endif
 
-Object Log(int i, Environment *env){
-    return fromDouble(log(get_double("x", i, env)));
+static void sinAll(const double *a, double *out, long n){
+    long i = 0;
+#ifdef LANES
+    const int all = (1 << LANES) - 1;
+    while(i + LANES <= n){
+        vec x = vload(a + i);
+        if(vmask(vle(vandnot(vset(-0.0), x), vset(LOSS))) == all)
+            vstore(out + i, sinVec(x));
+        else
+            for(int l = 0; l < LANES; l++)
+                out[i + l] = sin(a[i + l]);
+        i += LANES;
+    }
+#endif
+    while(i < n){
+        out[i] = sin(a[i]);
+        i++;
+    }
 }
 
-Object Log10(int i, Environment *env){
-    return fromDouble(log10(get_double("x", i, env)));
+static Object Sum(int i, Environment *env){
+    long n;
+    const double *a = get_doubles("a", i, env, &n);
+    return fromDouble(sumOf(a, n));
 }
 
-Object Exp(int i, Environment *env){
-    return fromDouble(exp(get_double("x", i, env)));
+static Object Dot(int i, Environment *env){
+    long n, m;
+    const double *a = get_doubles("a", i, env, &n), *b = get_doubles("b", i, env, &m);
+    if(n != m){
+        printf(runtime_error("Dot needs arrays of the same length!"), i);
+        stop();
+    }
+    return fromDouble(dotOf(a, b, n));
 }
 
-Object Abs(int i, Environment *env){
-    return fromDouble(fabs(get_double("x", i, env)));
+static Object ScaleAdd(int i, Environment *env){
+    long n, m;
+    const double *a = get_doubles("a", i, env, &n), *b = get_doubles("b", i, env, &m);
+    double k = get_double("k", i, env);
+    if(n != m){
+        printf(runtime_error("ScaleAdd needs arrays of the same length!"), i);
+        stop();
+    }
+    double *out = scratch_doubles(n);
+    scaleAdd(a, k, b, out, n);
+    return from_doubles(out, n);
 }
+
+static Object SinAll(int i, Environment *env){
+    long n;
+    const double *a = get_doubles("a", i, env, &n);
+    double *out = scratch_doubles(n);
+    sinAll(a, out, n);
+    return from_doubles(out, n);
+}
+
+// The Math module. It is compiled into the interpreter, and into
+// libnmath.so as an example of a library, where the table takes the
+// name every library uses. The double(double) routines are the libm
+// functions themselves, Integrate calls back into the script so it
+// takes (line, env).
+#ifdef FOREIGN_LIBRARY
+#define MathTable ForeignTable
+#endif
+
+ForeignSignature MathTable[] = {
+    {"Sin", "double(double)", (void *)sin},
+    {"Cos", "double(double)", (void *)cos},
+    {"Tan", "double(double)", (void *)tan},
+    {"ASin", "double(double)", (void *)asin},
+    {"ACos", "double(double)", (void *)acos},
+    {"ATan", "double(double)", (void *)atan},
+    {"Sinh", "double(double)", (void *)sinh},
+    {"Cosh", "double(double)", (void *)cosh},
+    {"Tanh", "double(double)", (void *)tanh},
+    {"Log", "double(double)", (void *)log},
+    {"Log10", "double(double)", (void *)log10},
+    {"Exp", "double(double)", (void *)exp},
+    {"Abs", "double(double)", (void *)fabs},
+    {"Integrate", NULL, (void *)Integrate},
+    {"Sum", NULL, (void *)Sum},
+    {"Dot", NULL, (void *)Dot},
+    {"ScaleAdd", NULL, (void *)ScaleAdd},
+    {"SinAll", NULL, (void *)SinAll},
+    {NULL, NULL, NULL}
+};
@@ -0,0 +1,699 @@
+#include <limits.h>
+
+#include "allocator.h"
+#include "native.h"
+#include "runtime.h"
+#include "symbol.h"
+#include "optimizer.h"
+
+// Folds operations whose operands are literals, and propagates globals
+// which are given a literal once and never assigned again. Operations
+// which would raise a runtime error are left for the interpreter.
+//
+// A global counts as constant only if its one assignment is a top level
+// Set executed before any top level call, so no routine can observe it
+// undefined. Native constants such as Math_Pi exist before any code runs.
+//
+// Set s = s + a + b is marked to append a, then b, straight to s, which
+// lets a string grow in place. That is only done when a and b do not
+// read s, and for globals when they make no call that could.
+//
+// While(i < n) or While(i <= n) over a local i the body only increases
+// by positive literals, with n a literal or a local it never assigns,
+// bounds every a[i + c] on a local array the body does not assign.
+// Those accesses are marked unchecked and the loop given a guard for
+// the compiler to test once on entry. Only innermost loops are guarded,
+// as the compiler emits a guarded loop twice.
+
+typedef struct{
+    char *name;
+    int assignments;
+    int isConstant;
+    Literal value;
+} Global;
+
+static Global *globals = NULL;
+static int globalCount = 0;
+
+static Global* lookup(char *name){
+    int i = 0;
+    while(i < globalCount){
+        if(globals[i].name == name)
+            return &globals[i];
+        i++;
+    }
+    return NULL;
+}
+
+static Global* global(char *name){
+    Global *g = lookup(name);
+    if(g != NULL)
+        return g;
+    globalCount++;
+    globals = (Global *)reallocate(globals, sizeof(Global) * globalCount);
+    g = &globals[globalCount - 1];
+    g->name = name;
+    g->assignments = 0;
+    g->isConstant = 0;
+    return g;
+}
+
+static void assigned(char *name){
+    global(name)->assignments++;
+}
+
+static void countBlock(Block b);
+
+static void countTarget(Expression *id){
+    if(id->type == EXPR_VARIABLE)
+        assigned(id->variable.name);
+    else if(id->type == EXPR_ARRAY)
+        assigned(id->arrayExpression.identifier);
+    else if(id->type == EXPR_REFERENCE) // members are put through the scope chain
+        countTarget(id->referenceExpression.member);
+}
+
+static void countArguments(char **arguments, int arity){
+    int i = 0;
+    while(i < arity){
+        assigned(arguments[i]);
+        i++;
+    }
+}
+
+static void countStatement(Statement *st){
+    int j;
+    switch(st->type){
+        case STATEMENT_SET:
+            for(j = 0;j < st->setStatement.count;j++)
+                countTarget(st->setStatement.initializers[j].identifer);
+            break;
+        case STATEMENT_ARRAY:
+            for(j = 0;j < st->arrayStatement.count;j++)
+                assigned(st->arrayStatement.initializers[j]->arrayExpression.identifier);
+            break;
+        case STATEMENT_INPUT:
+            for(j = 0;j < st->inputStatement.count;j++)
+                if(st->inputStatement.inputs[j].type == INPUT_IDENTIFER)
+                    assigned(st->inputStatement.inputs[j].identifer);
+            break;
+        case STATEMENT_IF:
+            countBlock(st->ifStatement.thenBranch);
+            countBlock(st->ifStatement.elseBranch);
+            break;
+        case STATEMENT_WHILE:
+            countBlock(st->whileStatement.body);
+            break;
+        case STATEMENT_ROUTINE:
+            countArguments(st->routine.arguments, st->routine.arity);
+            if(st->routine.isNative == 0)
+                countBlock(st->routine.code);
+            break;
+        case STATEMENT_CONTAINER:
+            countArguments(st->container.arguments, st->container.arity);
+            countBlock(st->container.constructor);
+            break;
+        default:
+            break;
+    }
+}
+
+static void countBlock(Block b){
+    int i = 0;
+    while(i < b.numStatements){
+        countStatement(&b.statements[i]);
+        i++;
+    }
+}
+
+static int isNumeric(Literal l){
+    return l.type == LIT_INT || l.type == LIT_DOUBLE;
+}
+
+// Mirrors the error checks of binaryOp
+static int canFoldBinary(Literal a, Literal b, TokenType op){
+    if(a.type == LIT_STRING && b.type == LIT_STRING)
+        return op == TOKEN_PLUS;
+    if(!isNumeric(a) || !isNumeric(b))
+        return 0;
+    if(op == TOKEN_PERCEN && (a.type == LIT_DOUBLE || b.type == LIT_DOUBLE))
+        return 0;
+    if((op == TOKEN_SLASH || op == TOKEN_PERCEN) && a.type == LIT_INT && b.type == LIT_INT
+            && (b.iVal == 0 || (b.iVal == -1 && a.iVal == LONG_MIN)))
+        return 0;
+    return 1;
+}
+
+// Mirrors the error checks of logicalOp
+static int canFoldLogical(Literal a, Literal b, TokenType op){
+    int equality = op == TOKEN_EQUAL_EQUAL || op == TOKEN_BANG_EQUAL;
+    if(a.type == LIT_NULL || b.type == LIT_NULL)
+        return equality;
+    if(a.type == LIT_STRING && b.type == LIT_STRING)
+        return op != TOKEN_AND && op != TOKEN_OR;
+    if(op == TOKEN_AND || op == TOKEN_OR)
+        return a.type == LIT_LOGICAL && b.type == LIT_LOGICAL;
+    return isNumeric(a) && isNumeric(b);
+}
+
+static void toLiteralExpression(Expression *expr, Literal value, int line){
+    if(value.type == LIT_STRING)
+        value.sVal = intern(value.sVal);
+    expr->type = EXPR_LITERAL;
+    expr->line = line;
+    expr->literal = value;
+}
+
+static void foldExpression(Expression *expr);
+
+static void foldMember(Expression *mem){
+    int i;
+    switch(mem->type){
+        case EXPR_ARRAY:
+            foldExpression(mem->arrayExpression.index);
+            break;
+        case EXPR_REFERENCE:
+            foldMember(mem->referenceExpression.containerName);
+            foldMember(mem->referenceExpression.member);
+            break;
+        case EXPR_CALL:
+            for(i = 0;i < mem->callExpression.argCount;i++)
+                foldExpression(mem->callExpression.arguments[i]);
+            break;
+        case EXPR_VARIABLE: // a member, not the global
+            break;
+        default:
+            foldExpression(mem);
+            break;
+    }
+}
+
+static void foldExpression(Expression *expr){
+    int i;
+    switch(expr->type){
+        case EXPR_VARIABLE:
+            {
+                Global *g = lookup(expr->variable.name);
+                Literal value;
+                if(expr->variable.slot >= 0)
+                    break;
+                if(g != NULL && g->isConstant)
+                    toLiteralExpression(expr, g->value, expr->variable.line);
+                // Never assigned, so only native constants have a value
+                else if(g == NULL && native_constant(expr->variable.name, &value))
+                    toLiteralExpression(expr, value, expr->variable.line);
+            }
+            break;
+        case EXPR_BINARY:
+            {
+                Binary b = expr->binary;
+                foldExpression(b.left);
+                foldExpression(b.right);
+                if(b.left->type == EXPR_LITERAL && b.right->type == EXPR_LITERAL
+                        && canFoldBinary(b.left->literal, b.right->literal, b.op.type)){
+                    Object o = binaryOp(b.left->literal, b.right->literal, b.op.type, b.line);
+                    toLiteralExpression(expr, o.literal, b.line);
+                }
+            }
+            break;
+        case EXPR_LOGICAL:
+            {
+                Logical l = expr->logical;
+                foldExpression(l.left);
+                foldExpression(l.right);
+                if(l.left->type == EXPR_LITERAL && l.right->type == EXPR_LITERAL
+                        && canFoldLogical(l.left->literal, l.right->literal, l.op.type)){
+                    Object o = logicalOp(fromLiteral(l.left->literal), fromLiteral(l.right->literal),
+                            l.op.type, l.line);
+                    toLiteralExpression(expr, o.literal, l.line);
+                }
+            }
+            break;
+        case EXPR_ARRAY:
+            foldExpression(expr->arrayExpression.index);
+            break;
+        case EXPR_CALL:
+            for(i = 0;i < expr->callExpression.argCount;i++)
+                foldExpression(expr->callExpression.arguments[i]);
+            break;
+        case EXPR_REFERENCE:
+            foldExpression(expr->referenceExpression.containerName);
+            foldMember(expr->referenceExpression.member);
+            break;
+        default:
+            break;
+    }
+}
+
+// Assignment targets are not values, only their indices are folded
+static void foldTarget(Expression *id){
+    if(id->type == EXPR_ARRAY)
+        foldExpression(id->arrayExpression.index);
+    else if(id->type == EXPR_REFERENCE)
+        foldMember(id->referenceExpression.member);
+}
+
+static int hasCall(Expression *expr){
+    switch(expr->type){
+        case EXPR_CALL:
+            return 1;
+        case EXPR_BINARY:
+            return hasCall(expr->binary.left) || hasCall(expr->binary.right);
+        case EXPR_LOGICAL:
+            return hasCall(expr->logical.left) || hasCall(expr->logical.right);
+        case EXPR_ARRAY:
+            return hasCall(expr->arrayExpression.index);
+        case EXPR_REFERENCE:
+            return hasCall(expr->referenceExpression.containerName)
+                || hasCall(expr->referenceExpression.member);
+        default:
+            return 0;
+    }
+}
+
+static int mentions(Expression *expr, char *name){
+    int i;
+    switch(expr->type){
+        case EXPR_VARIABLE:
+            return expr->variable.name == name;
+        case EXPR_ARRAY:
+            return expr->arrayExpression.identifier == name || mentions(expr->arrayExpression.index, name);
+        case EXPR_BINARY:
+            return mentions(expr->binary.left, name) || mentions(expr->binary.right, name);
+        case EXPR_LOGICAL:
+            return mentions(expr->logical.left, name) || mentions(expr->logical.right, name);
+        case EXPR_CALL:
+            for(i = 0;i < expr->callExpression.argCount;i++)
+                if(mentions(expr->callExpression.arguments[i], name))
+                    return 1;
+            return 0;
+        case EXPR_REFERENCE:
+            return mentions(expr->referenceExpression.containerName, name)
+                || mentions(expr->referenceExpression.member, name);
+        default:
+            return 0;
+    }
+}
+
+static int appendChain(Expression *expr, Variable *target){
+    if(expr->type == EXPR_VARIABLE)
+        return expr->variable.name == target->name;
+    if(expr->type != EXPR_BINARY || expr->binary.op.type != TOKEN_PLUS
+            || mentions(expr->binary.right, target->name)
+            || (target->slot < 0 && hasCall(expr->binary.right)))
+        return 0;
+    return appendChain(expr->binary.left, target);
+}
+
+static void markAppend(Initializer *in){
+    if(in->identifer->type == EXPR_VARIABLE && in->initializerExpression->type == EXPR_BINARY)
+        in->append = appendChain(in->initializerExpression, &in->identifer->variable);
+}
+
+#define MAX_OFFSET 100
+#define MAX_GUARDED 255 // arrays in one guard
+
+typedef struct{
+    Expression *access;
+    int offset;   // c in a[i + c]
+    int increase; // of i before the access, at most, in one iteration
+} Access;
+
+typedef struct{
+    int counter;
+    int bound;    // slot, -1 for a literal
+    int increase; // of i so far in the iteration, at most
+    int failed;
+    int accessCount;
+    Access *accesses;
+    int assignedCount;
+    int *assigned; // locals the body assigns
+} Induction;
+
+static int isCounter(Expression *expr, int counter){
+    return expr->type == EXPR_VARIABLE && expr->variable.slot == counter;
+}
+
+static int isSmallInt(Expression *expr){
+    return expr->type == EXPR_LITERAL && expr->literal.type == LIT_INT
+        && expr->literal.iVal >= -MAX_OFFSET && expr->literal.iVal <= MAX_OFFSET;
+}
+
+// Whether index is i + c or i - c, c a literal
+static int counterOffset(Expression *index, int counter, int *offset){
+    if(isCounter(index, counter)){
+        *offset = 0;
+        return 1;
+    }
+    if(index->type != EXPR_BINARY || !isCounter(index->binary.left, counter) || !isSmallInt(index->binary.right))
+        return 0;
+    if(index->binary.op.type == TOKEN_PLUS)
+        *offset = index->binary.right->literal.iVal;
+    else if(index->binary.op.type == TOKEN_MINUS)
+        *offset = -index->binary.right->literal.iVal;
+    else
+        return 0;
+    return 1;
+}
+
+static void scanIndices(Expression *expr, Induction *in){
+    int i, offset;
+    switch(expr->type){
+        case EXPR_ARRAY:
+            if(expr->arrayExpression.slot >= 0 && counterOffset(expr->arrayExpression.index, in->counter, &offset)){
+                in->accessCount++;
+                in->accesses = (Access *)reallocate(in->accesses, sizeof(Access) * in->accessCount);
+                in->accesses[in->accessCount - 1] = (Access){expr, offset, in->increase};
+            }
+            scanIndices(expr->arrayExpression.index, in);
+            break;
+        case EXPR_BINARY:
+            scanIndices(expr->binary.left, in);
+            scanIndices(expr->binary.right, in);
+            break;
+        case EXPR_LOGICAL:
+            scanIndices(expr->logical.left, in);
+            scanIndices(expr->logical.right, in);
+            break;
+        case EXPR_CALL:
+            for(i = 0;i < expr->callExpression.argCount;i++)
+                scanIndices(expr->callExpression.arguments[i], in);
+            break;
+        default: // members are not locals
+            break;
+    }
+}
+
+static void assignLocal(int slot, Induction *in){
+    if(slot < 0)
+        return;
+    if(slot == in->counter || slot == in->bound)
+        in->failed = 1;
+    in->assignedCount++;
+    in->assigned = (int *)reallocate(in->assigned, sizeof(int) * in->assignedCount);
+    in->assigned[in->assignedCount - 1] = slot;
+}
+
+// Set i = i + k, k a positive literal
+static void increment(Expression *init, Induction *in){
+    if(init->type != EXPR_BINARY || init->binary.op.type != TOKEN_PLUS
+            || !isCounter(init->binary.left, in->counter) || !isSmallInt(init->binary.right)
+            || init->binary.right->literal.iVal <= 0){
+        in->failed = 1;
+        return;
+    }
+    in->increase += init->binary.right->literal.iVal;
+    if(in->increase > MAX_OFFSET)
+        in->failed = 1;
+}
+
+static void scanBlock(Block b, Induction *in);
+
+static void scanStatement(Statement *st, Induction *in){
+    int j, increase, thenIncrease;
+    switch(st->type){
+        case STATEMENT_SET:
+            for(j = 0;j < st->setStatement.count;j++){
+                Expression *id = st->setStatement.initializers[j].identifer;
+                Expression *init = st->setStatement.initializers[j].initializerExpression;
+                if(id->type == EXPR_ARRAY)
+                    scanIndices(id, in);
+                scanIndices(init, in);
+                if(isCounter(id, in->counter))
+                    increment(init, in);
+                else if(id->type == EXPR_VARIABLE)
+                    assignLocal(id->variable.slot, in);
+            }
+            break;
+        case STATEMENT_ARRAY:
+            for(j = 0;j < st->arrayStatement.count;j++){
+                scanIndices(st->arrayStatement.initializers[j]->arrayExpression.index, in);
+                assignLocal(st->arrayStatement.initializers[j]->arrayExpression.slot, in);
+            }
+            break;
+        case STATEMENT_INPUT:
+            for(j = 0;j < st->inputStatement.count;j++)
+                if(st->inputStatement.inputs[j].type == INPUT_IDENTIFER)
+                    assignLocal(st->inputStatement.inputs[j].slot, in);
+            break;
+        case STATEMENT_PRINT:
+            for(j = 0;j < st->printStatement.argCount;j++)
+                scanIndices(st->printStatement.expressions[j], in);
+            break;
+        case STATEMENT_IF:
+            scanIndices(st->ifStatement.condition, in);
+            increase = in->increase;
+            scanBlock(st->ifStatement.thenBranch, in);
+            thenIncrease = in->increase;
+            in->increase = increase;
+            scanBlock(st->ifStatement.elseBranch, in);
+            if(thenIncrease > in->increase)
+                in->increase = thenIncrease;
+            break;
+        case STATEMENT_WHILE:
+            if(st->whileStatement.guard != NULL)
+                in->failed = 1;
+            scanIndices(st->whileStatement.condition, in);
+            increase = in->increase;
+            scanBlock(st->whileStatement.body, in);
+            if(in->increase != increase)
+                in->failed = 1;
+            break;
+        case STATEMENT_CALL:
+            scanIndices(st->callStatement.callee, in);
+            break;
+        case STATEMENT_RETURN:
+            if(st->returnStatement.value != NULL)
+                scanIndices(st->returnStatement.value, in);
+            break;
+        case STATEMENT_ROUTINE:
+        case STATEMENT_CONTAINER:
+            in->failed = 1;
+            break;
+        default:
+            break;
+    }
+}
+
+static void scanBlock(Block b, Induction *in){
+    int i = 0;
+    while(i < b.numStatements && !in->failed){
+        scanStatement(&b.statements[i], in);
+        i++;
+    }
+}
+
+static int isAssigned(int slot, Induction *in){
+    int i = 0;
+    while(i < in->assignedCount){
+        if(in->assigned[i] == slot)
+            return 1;
+        i++;
+    }
+    return 0;
+}
+
+// Returns 0 once the guard is full
+static int addGuarded(BoundsGuard *g, int slot, int low, int high){
+    int i = 0;
+    while(i < g->count){
+        if(g->arrays[i].slot == slot){
+            if(low < g->arrays[i].low)
+                g->arrays[i].low = low;
+            if(high > g->arrays[i].high)
+                g->arrays[i].high = high;
+            return 1;
+        }
+        i++;
+    }
+    if(g->count == MAX_GUARDED)
+        return 0;
+    g->count++;
+    g->arrays = (GuardedArray *)reallocate(g->arrays, sizeof(GuardedArray) * g->count);
+    g->arrays[g->count - 1] = (GuardedArray){slot, low, high};
+    return 1;
+}
+
+static void guardLoop(While *w){
+    Expression *c = w->condition;
+    Induction in = {0};
+    int i, strict;
+    if(c->type != EXPR_LOGICAL || (c->logical.op.type != TOKEN_LESS && c->logical.op.type != TOKEN_LESS_EQUAL)
+            || c->logical.left->type != EXPR_VARIABLE || c->logical.left->variable.slot < 0)
+        return;
+    in.counter = c->logical.left->variable.slot;
+    if(c->logical.right->type == EXPR_LITERAL && c->logical.right->literal.type == LIT_INT)
+        in.bound = -1;
+    else if(c->logical.right->type == EXPR_VARIABLE && c->logical.right->variable.slot >= 0
+            && c->logical.right->variable.slot != in.counter)
+        in.bound = c->logical.right->variable.slot;
+    else
+        return;
+    strict = c->logical.op.type == TOKEN_LESS;
+    scanBlock(w->body, &in);
+    for(i = 0;!in.failed && i < in.accessCount;i++){
+        Access a = in.accesses[i];
+        int slot = a.access->arrayExpression.slot;
+        if(isAssigned(slot, &in))
+            continue;
+        if(w->guard == NULL){
+            w->guard = (BoundsGuard *)mallocate(sizeof(BoundsGuard));
+            *w->guard = (BoundsGuard){c->logical.left, c->logical.right, 0, NULL};
+        }
+        if(addGuarded(w->guard, slot, a.offset, a.increase + a.offset - strict))
+            a.access->arrayExpression.unchecked = 1;
+    }
+    memfree(in.accesses);
+    memfree(in.assigned);
+}
+
+static void foldBlock(Block b);
+
+static void foldStatement(Statement *st){
+    int j;
+    switch(st->type){
+        case STATEMENT_SET:
+            for(j = 0;j < st->setStatement.count;j++){
+                foldTarget(st->setStatement.initializers[j].identifer);
+                foldExpression(st->setStatement.initializers[j].initializerExpression);
+                markAppend(&st->setStatement.initializers[j]);
+            }
+            break;
+        case STATEMENT_ARRAY:
+            for(j = 0;j < st->arrayStatement.count;j++)
+                foldExpression(st->arrayStatement.initializers[j]->arrayExpression.index);
+            break;
+        case STATEMENT_PRINT:
+            for(j = 0;j < st->printStatement.argCount;j++)
+                foldExpression(st->printStatement.expressions[j]);
+            break;
+        case STATEMENT_IF:
+            foldExpression(st->ifStatement.condition);
+            foldBlock(st->ifStatement.thenBranch);
+            foldBlock(st->ifStatement.elseBranch);
+            break;
+        case STATEMENT_WHILE:
+            foldExpression(st->whileStatement.condition);
+            foldBlock(st->whileStatement.body);
+            guardLoop(&st->whileStatement);
+            break;
+        case STATEMENT_CALL:
+            foldExpression(st->callStatement.callee);
+            break;
+        case STATEMENT_RETURN:
+            if(st->returnStatement.value != NULL)
+                foldExpression(st->returnStatement.value);
+            break;
+        case STATEMENT_ROUTINE:
+            if(st->routine.isNative == 0)
+                foldBlock(st->routine.code);
+            break;
+        case STATEMENT_CONTAINER:
+            foldBlock(st->container.constructor);
+            break;
+        default:
+            break;
+    }
+}
+
+static void foldBlock(Block b){
+    int i = 0;
+    while(i < b.numStatements){
+        foldStatement(&b.statements[i]);
+        i++;
+    }
+}
+
+static int blockHasCall(Block b);
+
+static int statementHasCall(Statement *st){
+    int j;
+    switch(st->type){
+        case STATEMENT_SET:
+            for(j = 0;j < st->setStatement.count;j++)
+                if(hasCall(st->setStatement.initializers[j].identifer)
+                        || hasCall(st->setStatement.initializers[j].initializerExpression))
+                    return 1;
+            return 0;
+        case STATEMENT_ARRAY:
+            for(j = 0;j < st->arrayStatement.count;j++)
+                if(hasCall(st->arrayStatement.initializers[j]))
+                    return 1;
+            return 0;
+        case STATEMENT_PRINT:
+            for(j = 0;j < st->printStatement.argCount;j++)
+                if(hasCall(st->printStatement.expressions[j]))
+                    return 1;
+            return 0;
+        case STATEMENT_IF:
+            return hasCall(st->ifStatement.condition) || blockHasCall(st->ifStatement.thenBranch)
+                || blockHasCall(st->ifStatement.elseBranch);
+        case STATEMENT_WHILE:
+            return hasCall(st->whileStatement.condition) || blockHasCall(st->whileStatement.body);
+        case STATEMENT_CALL:
+            return 1;
+        case STATEMENT_RETURN:
+            return st->returnStatement.value != NULL && hasCall(st->returnStatement.value);
+        default:
+            return 0;
+    }
+}
+
+static int blockHasCall(Block b){
+    int i = 0;
+    while(i < b.numStatements){
+        if(statementHasCall(&b.statements[i]))
+            return 1;
+        i++;
+    }
+    return 0;
+}
+
+// Top level statements run in order, so a global becomes constant only
+// from its defining Set onwards
+static void foldTopLevel(Statement *st){
+    int j;
+    if(st->type != STATEMENT_SET){
+        foldStatement(st);
+        return;
+    }
+    for(j = 0;j < st->setStatement.count;j++){
+        Expression *id = st->setStatement.initializers[j].identifer;
+        Expression *init = st->setStatement.initializers[j].initializerExpression;
+        foldTarget(id);
+        foldExpression(init);
+        markAppend(&st->setStatement.initializers[j]);
+        if(id->type == EXPR_VARIABLE && init->type == EXPR_LITERAL){
+            Global *g = lookup(id->variable.name);
+            if(g->assignments == 1){
+                g->isConstant = 1;
+                g->value = init->literal;
+            }
+        }
+    }
+}
+
+void optimize(Code c){
+    int i = 0, top = 0;
+    while(i < c.count){
+        countStatement(&c.parts[i]);
+        i++;
+    }
+    // Once a routine may have run, later definitions are no longer
+    // visible everywhere they are read
+    while(top < c.count){
+        Statement *st = &c.parts[top];
+        if(st->type != STATEMENT_ROUTINE && st->type != STATEMENT_CONTAINER){
+            if(statementHasCall(st))
+                break;
+            foldTopLevel(st);
+        }
+        top++;
+    }
+    for(i = 0;i < c.count;i++)
+        if(i >= top || c.parts[i].type == STATEMENT_ROUTINE || c.parts[i].type == STATEMENT_CONTAINER)
+            foldStatement(&c.parts[i]);
+    memfree(globals);
+    globals = NULL;
+    globalCount = 0;
+}
@@ -0,0 +1,8 @@
+#ifndef OPTIMIZER_H
+#define OPTIMIZER_H
+
+#include "stmt.h"
+
+void optimize(Code c);
+
+#endif
@@ -8,26 +8,41 @@
 #include "expr.h"
 #include "stmt.h"
 #include "allocator.h"
+#include "arena.h"
+#include "symbol.h"
 
 static int inWhile = 0;
 static int he = 0;
 static TokenList *head = NULL;
 static Token errorToken = {TOKEN_ERROR,"BadToken",0,-1};
 
+// Everything the parsed program holds lives in this arena
+static Arena program = {NULL};
+
+// Statements of the blocks being parsed, innermost last. A block is
+// copied out to the arena in one piece once it ends.
+static Statement *pending = NULL;
+static int pendingCount = 0, pendingCapacity = 0;
+
 typedef struct Compiler{
     struct Compiler *parent;
     int indentLevel;
     BlockType blockName;
 } Compiler;
 
-static Compiler* initCompiler(Compiler *parent, int indentLevel, BlockType blockName){
-    Compiler *ret = (Compiler *)mallocate(sizeof(Compiler));
-    ret->parent = parent;
-    ret->indentLevel = indentLevel;
-    ret->blockName = blockName;
+static Compiler initCompiler(Compiler *parent, int indentLevel, BlockType blockName){
+    Compiler ret = {parent, indentLevel, blockName};
     return ret;
 }
 
+static void* allocate(size_t size){
+    return arena_alloc(&program, size);
+}
+
+// Lists grow one element at a time, mostly in place at the end of the arena
+#define GROW(list, type, count) \
+    (type *)arena_resize(&program, list, sizeof(type) * ((count) - 1), sizeof(type) * (count))
+
 static TokenType peek(){
     if(head == NULL)
         return TOKEN_EOF;
@@ -127,7 +142,7 @@ static int isOperator(TokenType type){
 }
 
 static Expression* newExpression(){
-    Expression* expr = (Expression *)mallocate(sizeof(Expression));
+    Expression* expr = (Expression *)allocate(sizeof(Expression));
     expr->type = EXPR_NONE;
     return expr;
 }
@@ -135,23 +150,19 @@ static Expression* newExpression(){
 static Expression* expression();
 
 static char* numericString(Token t){
-    char* s = (char *)mallocate(sizeof(char) * t.length + 1);
+    char* s = (char *)allocate(sizeof(char) * t.length + 1);
     strncpy(s, t.start, t.length);
     s[t.length] = '\0';
     return s;
 }
 
 static char* stringOf(Token t){
-    if(t.type == TOKEN_NUMBER || t.type == TOKEN_IDENTIFIER)
+    if(t.type == TOKEN_NUMBER)
         return numericString(t);
-    //    printf("%s %d\n", t.start, t.length);
-    char* s = (char *)mallocate(sizeof(char) * (t.length-1));
-    int i;
-    for(i = 1;i < t.length-1;i++)
-        s[i-1] = t.start[i];
-    s[t.length - 2] = '\0';
-    // printf("\nGiven : %s of size %d \nReturing : [%s] of size %lu", t.start, t.length, s, strlen(s));
-    return s;
+    if(t.type == TOKEN_IDENTIFIER)
+        return intern_n(t.start, t.length);
+    // Strip the quotes
+    return intern_n(t.start + 1, t.length - 2);
 }
 
 static int isDouble(const char *string){
@@ -180,19 +191,19 @@ static Expression* primary(){
     Expression* expr = newExpression();
     if(match(TOKEN_TRUE)){
         expr->type = EXPR_LITERAL;
-        expr->literal.line = presentLine();
+        expr->line = presentLine();
         expr->literal.type = LIT_LOGICAL;
         expr->literal.lVal = 1;
     }
     else if(match(TOKEN_FALSE)){
         expr->type = EXPR_LITERAL;
-        expr->literal.line = presentLine();
+        expr->line = presentLine();
         expr->literal.type = LIT_LOGICAL;
         expr->literal.lVal = 0;
     }
     else if(match(TOKEN_NULL)){
         expr->type = EXPR_LITERAL;
-        expr->literal.line = presentLine();
+        expr->line = presentLine();
         expr->literal.type = LIT_NULL;
     }
     else if(peek() == TOKEN_MINUS){ // desugaring -x to 0 - x
@@ -202,11 +213,12 @@ static Expression* primary(){
         expr->binary.left->literal.type = LIT_INT;
         expr->binary.left->literal.dVal = 0;
         expr->binary.op = advance();
+        expr->binary.quick = QUICK_NONE;
         expr->binary.right = expression();
     }
     else if(peek() == TOKEN_NUMBER){
         expr->type = EXPR_LITERAL;
-        expr->literal.line = presentLine();
+        expr->line = presentLine();
         char *val = stringOf(advance());
         if(isDouble(val)){
             expr->literal.type = LIT_DOUBLE;
@@ -219,7 +231,7 @@ static Expression* primary(){
     }
     else if(peek() == TOKEN_STRING){
         expr->type = EXPR_LITERAL;
-        expr->literal.line = presentLine();
+        expr->line = presentLine();
         expr->literal.type = LIT_STRING;
         expr->literal.sVal = stringOf(advance());
     }
@@ -228,6 +240,8 @@ static Expression* primary(){
         if(match(TOKEN_LEFT_SQUARE)){
             expr->type = EXPR_ARRAY;
             expr->arrayExpression.identifier = name;
+            expr->arrayExpression.slot = -1;
+            expr->arrayExpression.unchecked = 0;
             expr->arrayExpression.line = presentLine();
             expr->arrayExpression.index = expression();
             consume(TOKEN_RIGHT_SQUARE, "Expected ']' after array index!");
@@ -236,10 +250,10 @@ static Expression* primary(){
             expr->type = EXPR_VARIABLE;
             expr->variable.line = presentLine();
             expr->variable.name = name;
+            expr->variable.slot = -1;
         }
     }
     else if(match(TOKEN_LEFT_PAREN)){
-        memfree(expr);
         expr = expression();
         consume(TOKEN_RIGHT_PAREN, "Expected '(' after expression.");
     }
@@ -256,14 +270,15 @@ static Expression* getCall(Expression* expr){
     call->callExpression.identifer = expr->variable.name;
     call->callExpression.argCount = 0;
     call->callExpression.arguments = NULL;
+    call->callExpression.type = CALL_UNBOUND;
     call->callExpression.line = presentLine();
     if(match(TOKEN_RIGHT_PAREN))
         return call;
     do{
         Expression *argument = expression();
         call->callExpression.argCount++;
-        call->callExpression.arguments = (Expression **)reallocate(call->callExpression.arguments, 
-                sizeof(Expression *)*call->callExpression.argCount);
+        call->callExpression.arguments = GROW(call->callExpression.arguments, Expression *,
+                call->callExpression.argCount);
         call->callExpression.arguments[call->callExpression.argCount - 1] = argument;
     } while(match(TOKEN_COMMA));
     consume(TOKEN_RIGHT_PAREN, "Expected '(' after expression!");
@@ -282,6 +297,8 @@ static Expression* call(){
             ex->referenceExpression.line = presentLine();
             ex->referenceExpression.containerName = expr;
             ex->referenceExpression.member = call();
+            ex->referenceExpression.cache.container = NULL;
+            ex->referenceExpression.cache.slot = 0;
             expr = ex;
         }
         else
@@ -297,6 +314,7 @@ static Expression* tothepower(){
         multi->type = EXPR_BINARY;
         multi->binary.line = presentLine();
         multi->binary.op = advance();
+        multi->binary.quick = QUICK_NONE;
         multi->binary.left = expr;
         multi->binary.right = tothepower();
         expr = multi;
@@ -311,6 +329,7 @@ static Expression* multiplication(){
         multi->type = EXPR_BINARY;
         multi->binary.line = presentLine();
         multi->binary.op = advance();
+        multi->binary.quick = QUICK_NONE;
         multi->binary.left = expr;
         multi->binary.right = tothepower();
         expr = multi;
@@ -326,6 +345,7 @@ static Expression* addition(){
         multi->type = EXPR_BINARY;
         multi->binary.line = presentLine();
         multi->binary.op = advance();
+        multi->binary.quick = QUICK_NONE;
         multi->binary.left = expr;
         multi->binary.right = multiplication();
         expr = multi;
@@ -341,6 +361,7 @@ static Expression* comparison(){
         multi->type = EXPR_LOGICAL;
         multi->logical.line = presentLine();
         multi->logical.op = advance();
+        multi->logical.quick = QUICK_NONE;
         multi->logical.left = expr;
         multi->logical.right = addition();
         expr = multi;
@@ -355,6 +376,7 @@ static Expression* equality(){
         multi->type = EXPR_LOGICAL;
         multi->logical.line = presentLine();
         multi->logical.op = advance();
+        multi->logical.quick = QUICK_NONE;
         multi->logical.left = expr;
         multi->logical.right = comparison();
         expr = multi;
@@ -369,6 +391,7 @@ static Expression* andE(){
         logic->type = EXPR_LOGICAL;
         logic->logical.line = presentLine();
         logic->logical.op = advance();
+        logic->logical.quick = QUICK_NONE;
         logic->logical.left = expr;
         logic->logical.right = equality();
         expr = logic;
@@ -383,6 +406,7 @@ static Expression* orE(){
         logic->type = EXPR_LOGICAL;
         logic->logical.line = presentLine();
         logic->logical.op = advance();
+        logic->logical.quick = QUICK_NONE;
         logic->logical.left = expr;
         logic->logical.right = andE();
         expr = logic;
@@ -401,23 +425,35 @@ static Block newBlock(){
     return b;
 }
 
-static void addToBlock(Block* block, Statement statement){
-    block->numStatements += 1;
-    block->statements = (Statement *)reallocate(block->statements, sizeof(Statement) * block->numStatements);
-    block->statements[block->numStatements-1] = statement;
+static void addPending(Statement statement){
+    if(pendingCount == pendingCapacity){
+        pendingCapacity = pendingCapacity == 0 ? 64 : pendingCapacity * 2;
+        pending = (Statement *)reallocate(pending, sizeof(Statement) * pendingCapacity);
+    }
+    pending[pendingCount++] = statement;
+}
+
+// Moves the statements pending since start into the arena
+static Statement* takePending(int start){
+    int count = pendingCount - start;
+    Statement *statements = (Statement *)allocate(sizeof(Statement) * count);
+    memcpy(statements, &pending[start], sizeof(Statement) * count);
+    pendingCount = start;
+    return statements;
 }
 
 static Block blockStatement(Compiler *compiler, BlockType name){
     debug("Parsing block statement");
-    int indent = compiler->indentLevel+1;
-    Compiler *blockCompiler = initCompiler(compiler, indent, name);
+    int indent = compiler->indentLevel+1, start = pendingCount;
+    Compiler blockCompiler = initCompiler(compiler, indent, name);
     Block b = newBlock();
     b.blockName = name;
     while(getNextIndent() == indent){
         debug("Found a block statement");
-        addToBlock(&b, statement(blockCompiler));
+        addPending(statement(&blockCompiler));
     }
-    memfree(blockCompiler);
+    b.numStatements = pendingCount - start;
+    b.statements = takePending(start);
     debug("Block statement parsed");
     return b;
 }
@@ -446,8 +482,9 @@ static Statement ifStatement(Compiler *compiler){
 
     if(match(TOKEN_ELSE)){
         if(match(TOKEN_IF)){
-            Block elseifBlock = {0, BLOCK_ELSE, NULL};
-            addToBlock(&elseifBlock, ifStatement(compiler));
+            Block elseifBlock = {1, BLOCK_ELSE, NULL};
+            elseifBlock.statements = (Statement *)allocate(sizeof(Statement));
+            elseifBlock.statements[0] = ifStatement(compiler);
             s.ifStatement.elseBranch = elseifBlock;
         }
         else{
@@ -476,6 +513,7 @@ static Statement whileStatement(Compiler* compiler){
     consume(TOKEN_LEFT_PAREN, "Expected left paren before conditional!");
     s.whileStatement.line = presentLine();
     s.whileStatement.condition = expression();
+    s.whileStatement.guard = NULL;
     consume(TOKEN_RIGHT_PAREN, "Expected right paren after conditional!");
     consume(TOKEN_NEWLINE, "Expected newline after While!");
 
@@ -543,10 +581,11 @@ static Statement setStatement(){
     s.setStatement.initializers = NULL;
     do{
         s.setStatement.count++;
-        s.setStatement.initializers = (Initializer *)reallocate(s.setStatement.initializers, sizeof(Initializer) * s.setStatement.count);
+        s.setStatement.initializers = GROW(s.setStatement.initializers, Initializer, s.setStatement.count);
         s.setStatement.initializers[s.setStatement.count - 1].identifer = expression();
         consume(TOKEN_EQUAL, "Expected '=' after identifer!");
         s.setStatement.initializers[s.setStatement.count - 1].initializerExpression = expression();
+        s.setStatement.initializers[s.setStatement.count - 1].append = 0;
     } while(match(TOKEN_COMMA));
     consume(TOKEN_NEWLINE, "Expected newline after Set statement!");
     debug("Set statement parsed");
@@ -560,16 +599,31 @@ static Statement arrayStatement(){
     s.arrayStatement.line = presentLine();
     s.arrayStatement.count = 0;
     s.arrayStatement.initializers = NULL;
+    s.arrayStatement.datatypes = NULL;
 
     do{
+        ArrayDataType datatype = ARRAY_ANY;
         s.arrayStatement.count++;
-        s.arrayStatement.initializers = (Expression **)reallocate(s.arrayStatement.initializers, 
-                sizeof(Expression *) * s.arrayStatement.count);
+        s.arrayStatement.initializers = GROW(s.arrayStatement.initializers, Expression *,
+                s.arrayStatement.count);
+        s.arrayStatement.datatypes = GROW(s.arrayStatement.datatypes, ArrayDataType,
+                s.arrayStatement.count);
         s.arrayStatement.initializers[s.arrayStatement.count - 1] = expression();
         if(s.arrayStatement.initializers[s.arrayStatement.count - 1]->type != EXPR_ARRAY){
             printf(line_error("Expected array expression!"), s.arrayStatement.line);
             he++;
         }
+        if(match(TOKEN_COLON)){
+            if(match(TOKEN_INT))
+                datatype = ARRAY_INT;
+            else if(match(TOKEN_FLOAT))
+                datatype = ARRAY_FLOAT;
+            else{
+                printf(line_error("Bad array element type!"), s.arrayStatement.line);
+                he++;
+            }
+        }
+        s.arrayStatement.datatypes[s.arrayStatement.count - 1] = datatype;
     } while(match(TOKEN_COMMA));
     consume(TOKEN_NEWLINE, "Expected newline after Array statement!");
     debug("Array statement parsed");
@@ -585,7 +639,7 @@ static Statement inputStatement(){
     s.inputStatement.inputs = 0;
     do{
         s.inputStatement.count++;
-        s.inputStatement.inputs = (Input *)reallocate(s.inputStatement.inputs, sizeof(Input) * s.inputStatement.count);
+        s.inputStatement.inputs = GROW(s.inputStatement.inputs, Input, s.inputStatement.count);
         Input i;
         if(peek() == TOKEN_STRING){
             i.type = INPUT_PROMPT;
@@ -594,6 +648,7 @@ static Statement inputStatement(){
         else if(peek() == TOKEN_IDENTIFIER){
             i.type = INPUT_IDENTIFER;
             i.identifer = stringOf(advance());
+            i.slot = -1;
             i.datatype = INPUT_ANY;
             if(match(TOKEN_COLON)){
                 if(match(TOKEN_INT))
@@ -624,12 +679,12 @@ static Statement printStatement(){
     debug("Parsing print statement");
 
     int count = 1;
-    Expression** exps = (Expression **)mallocate(sizeof(Expression *));
+    Expression** exps = (Expression **)allocate(sizeof(Expression *));
     exps[0] = expression();
     s.printStatement.line = presentLine();
     while(match(TOKEN_COMMA)){
         count++;
-        exps = (Expression **)reallocate(exps, sizeof(Expression *)*count);
+        exps = GROW(exps, Expression *, count);
         exps[count - 1] = expression();
     }
     s.printStatement.argCount = count;
@@ -664,6 +719,12 @@ static Statement routineStatement(Compiler *compiler){
     s.routine.arguments = NULL;   
     s.routine.name = NULL;
     s.routine.isNative = 0;
+    s.routine.localCount = 0;
+    s.routine.locals = NULL;
+    s.routine.chunk = NULL;
+    s.routine.foreign = NULL;
+    s.routine.binding = 0;
+    s.routine.signature = 0;
 
     if(compiler->indentLevel > 0){
         printf(line_error("Routines can only be declared in top level indent!"), presentLine());
@@ -678,7 +739,7 @@ static Statement routineStatement(Compiler *compiler){
     if(peek() != TOKEN_RIGHT_PAREN){
         do{
             s.routine.arity++;
-            s.routine.arguments = (char **)reallocate(s.routine.arguments, sizeof(char *) * s.routine.arity);
+            s.routine.arguments = GROW(s.routine.arguments, char *, s.routine.arity);
             s.routine.arguments[s.routine.arity - 1] = stringOf(consume(TOKEN_IDENTIFIER, "Expected identifer as argument!"));
         } while(match(TOKEN_COMMA));
         consume(TOKEN_RIGHT_PAREN, "Expected ')' after argument declaration!");
@@ -724,11 +785,13 @@ static Statement containerStatement(Compiler *c){
     s.container.name = stringOf(head->value);
     s.container.line = presentLine();
     s.container.arity = 0;
+    s.container.arguments = NULL;
+    s.container.chunk = NULL;
     consume(TOKEN_IDENTIFIER, "Expected container identifer!");
     consume(TOKEN_LEFT_PAREN, "Expected '(' after container name");
     while(!match(TOKEN_RIGHT_PAREN) && !match(TOKEN_EOF)){
         s.container.arity++;
-        s.container.arguments = (char **)mallocate(sizeof(char *) * s.container.arity);
+        s.container.arguments = GROW(s.container.arguments, char *, s.container.arity);
         s.container.arguments[s.container.arity - 1] = stringOf(consume(TOKEN_IDENTIFIER, "Expected identifer as argument!"));
     }
     consume(TOKEN_NEWLINE, "Expected newline after container declaration!");
@@ -806,16 +869,21 @@ Statement part(Compiler *c){
 Code parse(TokenList *list){
     Code c = {0, NULL};
     head = list;
-    Compiler *comp = initCompiler(NULL, 0, BLOCK_NONE);
-    while(!match(TOKEN_EOF)){
-        c.count++;
-        c.parts = (Statement *)reallocate(c.parts, sizeof(Statement) * c.count);
-        c.parts[c.count - 1] = part(comp);
-    }
-    memfree(comp);
+    Compiler comp = initCompiler(NULL, 0, BLOCK_NONE);
+    while(!match(TOKEN_EOF))
+        addPending(part(&comp));
+    c.count = pendingCount;
+    c.parts = takePending(0);
+    memfree(pending);
+    pending = NULL;
+    pendingCapacity = 0;
     return c;
 }
 
+void freeCode(){
+    arena_free(&program);
+}
+
 int hasParseError(){
     return he;
 }
@@ -6,5 +6,7 @@
 
 Code parse(TokenList *list);
 int hasParseError();
+// Releases all that parse allocated, the whole program at once
+void freeCode();
 
 #endif
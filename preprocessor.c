@@ -147,8 +147,10 @@ char* preprocess(char *source){
                 continue;
             }
             FILE *include = fopen(toInclude, "rb");
-            if(include == NULL)
+            if(include == NULL){
                 printf(warning("[Line %d] Unable to open file for inclusion : %s"), lcount, toInclude);
+                memfree(toInclude);
+            }
             else{
                 hasInclude++;
                 char *content = read_all(include);
@@ -158,7 +160,7 @@ char* preprocess(char *source){
                 memfree(content);
                 memfree(bak);
             }
-            memfree(toInclude);
+            memfree(line); // the table keeps toInclude
         }
         else if(!isEmpty(line)){
             if(is_start_of_mc(line)){
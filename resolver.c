@@ -0,0 +1,312 @@
+#include <stdio.h>
+
+#include "display.h"
+#include "allocator.h"
+#include "native.h"
+#include "resolver.h"
+
+// Assigns frame slots to the arguments and locals of each routine.
+// A name is local to a routine if it is an argument, or if the routine
+// assigns it (Set, Array, Input) and no global of that name exists.
+// Globals, container members and container constructors stay named.
+//
+// Also links each call to the routine or container it names, checking
+// the argument count once. Calls to names shadowed by a variable, or to
+// nothing defined, stay unbound and are looked up when executed.
+
+typedef struct{
+    int count;
+    char **names;
+} Scope;
+
+typedef struct{
+    CallType type;
+    union{
+        Routine *routine;
+        Container *container;
+    };
+} Definition;
+
+static Scope globals = {0, NULL};
+static Scope variables = {0, NULL}; // globals assigned at the top level
+static Scope defined = {0, NULL};
+static Definition *definitions = NULL;
+static int le = 0;
+
+static int indexOf(Scope *s, char *name){
+    int i = 0;
+    while(i < s->count){
+        if(s->names[i] == name)
+            return i;
+        i++;
+    }
+    return -1;
+}
+
+static void add(Scope *s, char *name){
+    s->count++;
+    s->names = (char **)reallocate(s->names, sizeof(char *) * s->count);
+    s->names[s->count - 1] = name;
+}
+
+static int isGlobal(char *name){
+    return indexOf(&globals, name) != -1 || is_native_global(name);
+}
+
+static void define(char *name, Definition d){
+    add(&defined, name);
+    definitions = (Definition *)reallocate(definitions, sizeof(Definition) * defined.count);
+    definitions[defined.count - 1] = d;
+}
+
+static void linkCall(Scope *s, Call *c){
+    int i = indexOf(&defined, c->identifer), arity;
+    Definition d;
+    if(indexOf(s, c->identifer) != -1 || indexOf(&variables, c->identifer) != -1)
+        return;
+    if(i != -1)
+        d = definitions[i];
+    else if((d.routine = native_routine(c->identifer)) != NULL)
+        d.type = CALL_FOREIGN;
+    else
+        return;
+
+    arity = d.type == CALL_CONTAINER ? d.container->arity : d.routine->arity;
+    if(arity != c->argCount){
+        printf(line_error("Argument count mismatch for %s %s! Expected : %d Received %d!"), c->line,
+                d.type == CALL_CONTAINER ? "container" : "routine", c->identifer, arity, c->argCount);
+        le++;
+        return;
+    }
+    c->type = d.type;
+    c->routine = d.routine;
+    if(d.type == CALL_CONTAINER)
+        c->container = d.container;
+}
+
+static void declare(Scope *s, char *name){
+    if(!isGlobal(name) && indexOf(s, name) == -1)
+        add(s, name);
+}
+
+static void declareBlock(Scope *s, Block b){
+    int i = 0, j;
+    while(i < b.numStatements){
+        Statement *st = &b.statements[i];
+        switch(st->type){
+            case STATEMENT_SET:
+                for(j = 0;j < st->setStatement.count;j++){
+                    Expression *id = st->setStatement.initializers[j].identifer;
+                    if(id->type == EXPR_VARIABLE)
+                        declare(s, id->variable.name);
+                }
+                break;
+            case STATEMENT_ARRAY:
+                for(j = 0;j < st->arrayStatement.count;j++)
+                    declare(s, st->arrayStatement.initializers[j]->arrayExpression.identifier);
+                break;
+            case STATEMENT_INPUT:
+                for(j = 0;j < st->inputStatement.count;j++)
+                    if(st->inputStatement.inputs[j].type == INPUT_IDENTIFER)
+                        declare(s, st->inputStatement.inputs[j].identifer);
+                break;
+            case STATEMENT_IF:
+                declareBlock(s, st->ifStatement.thenBranch);
+                declareBlock(s, st->ifStatement.elseBranch);
+                break;
+            case STATEMENT_WHILE:
+                declareBlock(s, st->whileStatement.body);
+                break;
+            default:
+                break;
+        }
+        i++;
+    }
+}
+
+static void resolveExpression(Scope *s, Expression *expr){
+    int i;
+    switch(expr->type){
+        case EXPR_VARIABLE:
+            expr->variable.slot = indexOf(s, expr->variable.name);
+            break;
+        case EXPR_ARRAY:
+            expr->arrayExpression.slot = indexOf(s, expr->arrayExpression.identifier);
+            resolveExpression(s, expr->arrayExpression.index);
+            break;
+        case EXPR_BINARY:
+            resolveExpression(s, expr->binary.left);
+            resolveExpression(s, expr->binary.right);
+            break;
+        case EXPR_LOGICAL:
+            resolveExpression(s, expr->logical.left);
+            resolveExpression(s, expr->logical.right);
+            break;
+        case EXPR_CALL:
+            for(i = 0;i < expr->callExpression.argCount;i++)
+                resolveExpression(s, expr->callExpression.arguments[i]);
+            linkCall(s, &expr->callExpression);
+            break;
+        case EXPR_REFERENCE:
+            // The member is evaluated inside the instance
+            resolveExpression(s, expr->referenceExpression.containerName);
+            break;
+        default:
+            break;
+    }
+}
+
+// Mirrors write_ref : only the outermost container, the member index
+// and the value are evaluated in the routine
+static void resolveWriteRef(Scope *s, Expression *id, int nested){
+    Expression *mem = id->referenceExpression.member;
+    if(!nested)
+        resolveExpression(s, id->referenceExpression.containerName);
+    if(mem->type == EXPR_ARRAY)
+        resolveExpression(s, mem->arrayExpression.index);
+    else if(mem->type == EXPR_REFERENCE)
+        resolveWriteRef(s, mem, 1);
+}
+
+static void resolveBlock(Scope *s, Block b);
+
+static void resolveStatement(Scope *s, Statement *st){
+    int j;
+    switch(st->type){
+        case STATEMENT_SET:
+            for(j = 0;j < st->setStatement.count;j++){
+                Expression *id = st->setStatement.initializers[j].identifer;
+                if(id->type == EXPR_REFERENCE)
+                    resolveWriteRef(s, id, 0);
+                else
+                    resolveExpression(s, id);
+                resolveExpression(s, st->setStatement.initializers[j].initializerExpression);
+            }
+            break;
+        case STATEMENT_ARRAY:
+            for(j = 0;j < st->arrayStatement.count;j++)
+                resolveExpression(s, st->arrayStatement.initializers[j]);
+            break;
+        case STATEMENT_INPUT:
+            for(j = 0;j < st->inputStatement.count;j++){
+                Input *in = &st->inputStatement.inputs[j];
+                if(in->type == INPUT_IDENTIFER)
+                    in->slot = indexOf(s, in->identifer);
+            }
+            break;
+        case STATEMENT_PRINT:
+            for(j = 0;j < st->printStatement.argCount;j++)
+                resolveExpression(s, st->printStatement.expressions[j]);
+            break;
+        case STATEMENT_IF:
+            resolveExpression(s, st->ifStatement.condition);
+            resolveBlock(s, st->ifStatement.thenBranch);
+            resolveBlock(s, st->ifStatement.elseBranch);
+            break;
+        case STATEMENT_WHILE:
+            resolveExpression(s, st->whileStatement.condition);
+            resolveBlock(s, st->whileStatement.body);
+            break;
+        case STATEMENT_CALL:
+            resolveExpression(s, st->callStatement.callee);
+            break;
+        case STATEMENT_RETURN:
+            if(st->returnStatement.value != NULL)
+                resolveExpression(s, st->returnStatement.value);
+            break;
+        default:
+            break;
+    }
+}
+
+static void resolveBlock(Scope *s, Block b){
+    int i = 0;
+    while(i < b.numStatements){
+        resolveStatement(s, &b.statements[i]);
+        i++;
+    }
+}
+
+static void resolveRoutine(Routine *r){
+    Scope s = {0, NULL};
+    int i = 0;
+    while(i < r->arity){
+        add(&s, r->arguments[i]);
+        i++;
+    }
+    declareBlock(&s, r->code);
+    resolveBlock(&s, r->code);
+    r->localCount = s.count;
+    r->locals = s.names;
+}
+
+static void collectGlobals(Code c){
+    int i = 0, j;
+    Definition d;
+    while(i < c.count){
+        Statement *st = &c.parts[i];
+        switch(st->type){
+            case STATEMENT_ROUTINE:
+                add(&globals, st->routine.name);
+                d.type = st->routine.isNative ? CALL_FOREIGN : CALL_ROUTINE;
+                d.routine = &st->routine;
+                define(st->routine.name, d);
+                break;
+            case STATEMENT_CONTAINER:
+                add(&globals, st->container.name);
+                d.type = CALL_CONTAINER;
+                d.container = &st->container;
+                define(st->container.name, d);
+                break;
+            case STATEMENT_SET:
+                for(j = 0;j < st->setStatement.count;j++){
+                    Expression *id = st->setStatement.initializers[j].identifer;
+                    if(id->type == EXPR_VARIABLE){
+                        add(&globals, id->variable.name);
+                        add(&variables, id->variable.name);
+                    }
+                }
+                break;
+            case STATEMENT_ARRAY:
+                for(j = 0;j < st->arrayStatement.count;j++){
+                    add(&globals, st->arrayStatement.initializers[j]->arrayExpression.identifier);
+                    add(&variables, st->arrayStatement.initializers[j]->arrayExpression.identifier);
+                }
+                break;
+            default:
+                break;
+        }
+        i++;
+    }
+}
+
+static void freeScope(Scope *s){
+    memfree(s->names);
+    s->count = 0;
+    s->names = NULL;
+}
+
+void resolve(Code c){
+    int i = 0;
+    Scope top = {0, NULL};
+    collectGlobals(c);
+    while(i < c.count){
+        Statement *st = &c.parts[i];
+        if(st->type == STATEMENT_ROUTINE && st->routine.isNative == 0)
+            resolveRoutine(&st->routine);
+        else if(st->type == STATEMENT_CONTAINER)
+            resolveBlock(&top, st->container.constructor);
+        else
+            resolveStatement(&top, st);
+        i++;
+    }
+    freeScope(&globals);
+    freeScope(&variables);
+    freeScope(&defined);
+    memfree(definitions);
+    definitions = NULL;
+}
+
+int hasLinkError(){
+    return le;
+}
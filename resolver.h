@@ -0,0 +1,9 @@
+#ifndef RESOLVER_H
+#define RESOLVER_H
+
+#include "stmt.h"
+
+void resolve(Code c);
+int hasLinkError();
+
+#endif
@@ -0,0 +1,475 @@
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#include "display.h"
+#include "allocator.h"
+#include "runtime.h"
+#include "gc.h"
+#include "str.h"
+
+static int instanceCount = 0;
+
+static int isNumeric(Literal l){
+    return l.type == LIT_INT || l.type == LIT_DOUBLE;
+}
+
+Object fromLiteral(Literal l){
+    Object o = {.literal = l, .type = OBJECT_LITERAL};
+    return o;
+}
+
+Literal toLiteral(Object o, int line){
+    if(o.type == OBJECT_NULL)
+        return nullLiteral;
+    if(o.type != OBJECT_LITERAL){
+        printf(runtime_error("Expected literal, Received %d!"), line, o.type);
+        stop();
+    }
+    return o.literal;
+}
+
+int isTruthy(Object o, int line){
+    Literal cond = toLiteral(o, line);
+    if(cond.type != LIT_LOGICAL){
+        printf(runtime_error("Not a logical expression as condition!"), line);
+        stop();
+    }
+    return cond.lVal;
+}
+
+// Exact for non negative exponents, where pow() would round through a double
+long intPower(long base, long exponent){
+    unsigned long result = 1, b = base; // wraps on overflow
+    if(exponent < 0)
+        return pow(base, exponent);
+    while(exponent > 0){
+        if(exponent & 1)
+            result *= b;
+        b *= b;
+        exponent >>= 1;
+    }
+    return (long)result;
+}
+
+static void checkLength(size_t length, int line){
+    if(length > STR_MAX_LENGTH){
+        printf(runtime_error("String too long [%zu characters]!"), line, length);
+        stop();
+    }
+}
+
+Object binaryOp(Literal left, Literal right, TokenType op, int line){
+    //   printf("\n[Binary] Got %s and %s for operator %s", literalNames[left.type], literalNames[right.type], tokenNames[op]);
+    if(left.type == LIT_STRING && right.type == LIT_STRING && op == TOKEN_PLUS){
+        Literal ret = {.type = LIT_STRING};
+        size_t a = str_length(left.sVal), b = str_length(right.sVal);
+        checkLength(a + b, line);
+        ret.sVal = gc_string(a + b);
+        memcpy(ret.sVal, left.sVal, a);
+        memcpy(ret.sVal + a, right.sVal, b);
+        return fromLiteral(ret);
+    }
+    else if (!isNumeric(left) || !isNumeric(right)){
+        printf(runtime_error("Binary operation can only be done on numerical values!"), line);
+        stop();
+        return nullObject;
+    }
+    Literal ret = {.type = LIT_NULL};
+    if(left.type == LIT_INT && right.type == LIT_INT){
+        ret.type = LIT_INT;
+        switch(op){
+            case TOKEN_PLUS:
+                ret.iVal = left.iVal + right.iVal;
+                break;
+            case TOKEN_MINUS:
+                ret.iVal = left.iVal - right.iVal;
+                break;
+            case TOKEN_STAR:
+                ret.iVal = left.iVal * right.iVal;
+                break;
+            case TOKEN_SLASH:
+                ret.iVal = left.iVal / right.iVal;
+                break;
+            case TOKEN_CARET:
+                ret.iVal = intPower(left.iVal, right.iVal);
+                break;
+            case TOKEN_PERCEN:
+                ret.iVal = left.iVal % right.iVal;
+                break;
+            default:
+                break;
+        }
+    }
+    else{
+        ret.type = LIT_DOUBLE;
+        double a = left.type == LIT_INT?left.iVal:left.dVal;
+        double b = right.type == LIT_INT?right.iVal:right.dVal;
+        switch(op){
+            case TOKEN_PLUS:
+                ret.dVal = a + b;
+                break;
+            case TOKEN_MINUS:
+                ret.dVal = a - b;
+                break;
+            case TOKEN_STAR:
+                ret.dVal = a * b;
+                break;
+            case TOKEN_SLASH:
+                ret.dVal = a / b;
+                break;
+            case TOKEN_CARET:
+                ret.dVal = pow(a, b);
+                break;
+            case TOKEN_PERCEN:
+                printf(runtime_error("%% can only be applied between two integers!"), line);
+                stop();
+                break;
+            default:
+                break;
+        }
+    }
+    return fromLiteral(ret);
+}
+
+static Object compareInstance(Object a, Object b, TokenType op, int line){
+    if(a.type == OBJECT_INSTANCE && b.type == OBJECT_INSTANCE){
+        Literal ret = {.type = LIT_LOGICAL};
+        switch(op){
+            case TOKEN_EQUAL_EQUAL:
+                ret.lVal = a.instance == b.instance;
+                break;
+            case TOKEN_BANG_EQUAL:
+                ret.lVal = a.instance != b.instance;
+                break;
+            default:
+                printf(runtime_error("Can't compare container instances!"), line);
+                stop();
+                break;
+        }
+        return fromLiteral(ret);
+    }
+    else if((a.type == OBJECT_INSTANCE && b.type == OBJECT_LITERAL)
+            || (a.type == OBJECT_LITERAL && b.type == OBJECT_INSTANCE)){
+        Literal lit = a.type == OBJECT_LITERAL ? a.literal : b.literal;
+        Instance* o = a.type == OBJECT_INSTANCE ? a.instance : b.instance;
+        if(lit.type != LIT_NULL){
+            printf(runtime_error("Unable to compare between literal and instances!"), line);
+            stop();
+        }
+        Literal ret = {.type = LIT_LOGICAL};
+        switch(op){
+            case TOKEN_EQUAL_EQUAL:
+                ret.lVal = o == NULL;
+                break;
+            case TOKEN_BANG_EQUAL:
+                ret.lVal = o != NULL;
+                break;
+            default:
+                printf(runtime_error("Null can't be compared!"), line);
+                stop();
+                break;
+        }
+        return fromLiteral(ret);
+    }
+    return nullObject;
+}
+
+Object logicalOp(Object leftObject, Object rightObject, TokenType op, int line){
+    Object r = compareInstance(leftObject, rightObject, op, line);
+    if(r.type != OBJECT_NULL)
+        return r;
+    Literal left = toLiteral(leftObject, line);
+    Literal right = toLiteral(rightObject, line);
+    //    printf("\n[Logical] Got %s and %s for operator %s", literalNames[left.type], literalNames[right.type], tokenNames[op]);
+    if(left.type == LIT_NULL || right.type == LIT_NULL){
+        Literal ret = {.type = LIT_LOGICAL};
+        switch(op){
+            case TOKEN_EQUAL_EQUAL:
+                ret.lVal = left.type == LIT_NULL && right.type == LIT_NULL;
+                break;
+            case TOKEN_BANG_EQUAL:
+                ret.lVal = left.type != LIT_NULL || right.type != LIT_NULL;
+                break;
+            default:
+                printf(runtime_error("Unable to compare Null!"), line);
+                break;
+        }
+        return fromLiteral(ret);
+    }
+    if(left.type == LIT_STRING && right.type == LIT_STRING){
+        Literal ret = {.type = LIT_LOGICAL};
+        switch(op){
+            case TOKEN_GREATER:
+                ret.lVal = str_length(left.sVal) > str_length(right.sVal);
+                break;
+            case TOKEN_GREATER_EQUAL:
+                ret.lVal = str_length(left.sVal) >= str_length(right.sVal);
+                break;
+            case TOKEN_LESS:
+                ret.lVal = str_length(left.sVal) < str_length(right.sVal);
+                break;
+            case TOKEN_LESS_EQUAL:
+                ret.lVal = str_length(left.sVal) <= str_length(right.sVal);
+                break;
+            case TOKEN_EQUAL_EQUAL:
+                ret.lVal = str_equal(left.sVal, right.sVal);
+                break;
+            case TOKEN_BANG_EQUAL:
+                ret.lVal = !str_equal(left.sVal, right.sVal);
+                break;
+            default:
+                printf(runtime_error("Bad logical operator between string operands!"), line);
+                stop();
+                break;
+        }
+        return fromLiteral(ret);
+    }
+    else if((!isNumeric(left) && left.type != LIT_LOGICAL)
+            || (!isNumeric(right) && right.type != LIT_LOGICAL)){
+        printf(runtime_error("Bad operand for logical operator!"), line);
+        stop();
+        return nullObject;
+    }
+    Literal ret;
+    ret.type = LIT_LOGICAL;
+    double a = left.type == LIT_INT?left.iVal:left.dVal;
+    double b = right.type == LIT_INT?right.iVal:right.dVal;
+    switch(op){
+        case TOKEN_GREATER:
+            ret.lVal = a > b;
+            break;
+        case TOKEN_GREATER_EQUAL:
+            ret.lVal = a >= b;
+            break;
+        case TOKEN_LESS:
+            ret.lVal = a < b;
+            break;
+        case TOKEN_LESS_EQUAL:
+            ret.lVal = a <= b;
+            break;
+        case TOKEN_EQUAL_EQUAL:
+            ret.lVal = fabs(a - b) <= EPSILON;
+            break;
+        case TOKEN_BANG_EQUAL:
+            ret.lVal = fabs(a - b) > EPSILON;
+            break;
+        case TOKEN_AND:
+            if(left.type != LIT_LOGICAL || right.type != LIT_LOGICAL){
+                printf(runtime_error("'And' can only be applied over logical expressions!"), line);
+                stop();
+            }
+            ret.lVal = left.lVal & right.lVal;
+            break;
+        case TOKEN_OR:
+            if(left.type != LIT_LOGICAL || right.type != LIT_LOGICAL){
+                printf(runtime_error("'Or' can only be applied over logical expressions!"), line);
+                stop();
+            }
+            ret.lVal = left.lVal | right.lVal;
+            break;
+        default:
+            break;
+    }
+    return fromLiteral(ret);
+}
+
+void checkIndex(Literal index, int line){
+    if(index.type != LIT_INT){
+        printf(runtime_error("Array index must be an integer!"), line);
+        stop();
+    }
+}
+
+static Object* checkTarget(Object *target, char *identifer, int line){
+    if(target == NULL || target->type == OBJECT_UNDEFINED){
+        printf(runtime_error("Undefined variable %s!"), line, identifer);
+        stop();
+    }
+    return target;
+}
+
+Object readIndex(Object *target, char *identifer, Literal index, int line){
+    checkIndex(index, line);
+    Object get = *checkTarget(target, identifer, line);
+    if(get.type == OBJECT_LITERAL && get.literal.type == LIT_STRING){
+        char *s = get.literal.sVal;
+        long le = str_length(s);
+        long in = index.iVal;
+        if(in < 1 || in > (le+1)){
+            printf(runtime_error("String index out of range [%ld]!"), line, in);
+            stop();
+        }
+        if(in == le+1)
+            return nullObject;
+        Literal l;
+        l.type =  LIT_STRING;
+        l.sVal = str_char(s[in - 1]);
+        return fromLiteral(l);
+    }
+    return slot_arr_get(target, identifer, line, index.iVal);
+}
+
+void writeIndex(Object *target, char *identifer, Literal index, Object value, int line){
+    checkIndex(index, line);
+    Object get = *checkTarget(target, identifer, line);
+    if(get.type == OBJECT_LITERAL && get.literal.type == LIT_STRING){
+        Literal rep = toLiteral(value, line);
+        if(index.iVal < 1){
+            printf(runtime_error("String index must be positive!"), line);
+            stop();
+        }
+        if(rep.type != LIT_STRING){
+            printf(runtime_error("Bad assignment to a string!"), line);
+            stop();
+        }
+        if((size_t)index.iVal > str_length(get.literal.sVal)){
+            printf(runtime_error("String index out of range [%ld]!"), line, index.iVal);
+            stop();
+        }
+        if(str_length(rep.sVal) > 1)
+            printf(warning("[Line %d] Ignoring extra characters while assignment!"), line);
+        String *h = str_header(get.literal.sVal);
+        if(!h->heap || h->shared){ // symbols and aliased strings are copied on write
+            char *s = gc_string(h->length);
+            memcpy(s, get.literal.sVal, h->length);
+            target->literal.sVal = get.literal.sVal = s;
+            h = str_header(s);
+        }
+        get.literal.sVal[index.iVal - 1] = rep.sVal[0];
+        if(rep.sVal[0] == '\0') // an empty string cuts it short
+            h->length = index.iVal - 1;
+        h->hash = 0;
+    }
+    else
+        slot_arr_put(target, identifer, line, index.iVal, value);
+}
+
+static int isString(Object o){
+    return o.type == OBJECT_LITERAL && o.literal.type == LIT_STRING;
+}
+
+// Strings double their room when copied, so appending n characters
+// one at a time costs O(n) overall
+static void appendString(Object *target, char *s, int line){
+    char *t = target->literal.sVal;
+    String *h = str_header(t);
+    size_t length = h->length, extra = str_length(s);
+    checkLength(length + extra, line);
+    if(!h->heap || h->shared || gc_string_capacity(t) < length + extra){
+        size_t capacity = length * 2 > length + extra ? length * 2 : length + extra;
+        char *grown = gc_string_room(length, capacity < 16 ? 16 : capacity);
+        memcpy(grown, t, length);
+        target->literal.sVal = t = grown;
+        h = str_header(t);
+    }
+    memcpy(t + length, s, extra);
+    h->length = length + extra;
+    t[h->length] = '\0';
+    h->hash = 0;
+}
+
+void appendTo(Object *target, char *identifer, Object value, int line){
+    Object get = *checkTarget(target, identifer, line);
+    if(isString(get) && isString(value)){
+        appendString(target, value.literal.sVal, line);
+        return;
+    }
+    if(get.type == OBJECT_LITERAL && value.type == OBJECT_LITERAL && get.literal.type == value.literal.type){
+        if(get.literal.type == LIT_INT){
+            target->literal.iVal += value.literal.iVal;
+            return;
+        }
+        if(get.literal.type == LIT_DOUBLE){
+            target->literal.dVal += value.literal.dVal;
+            return;
+        }
+    }
+    slot_put(target, identifer, line, binaryOp(toLiteral(get, line), toLiteral(value, line), TOKEN_PLUS, line));
+}
+
+Object newInstance(char *name, Environment *env){
+    Object o;
+    o.type = OBJECT_INSTANCE;
+    o.instance = gc_instance();
+    o.instance->name = name;
+    o.instance->environment = env;
+    o.instance->insCount = ++instanceCount;
+    return o;
+}
+
+void discardResult(Object o, int line){
+    if(o.type != OBJECT_NULL)
+        printf(warning("[Line %d] Ignoring return value!"), line);
+}
+
+void printString(const char *s){
+    int i = 0, len = str_length(s);
+    //printf("\nPrinting : %s", s);
+    while(i < len){
+        if(s[i] == '\\' && i < (len - 1)){
+            if(s[i+1] == 'n'){
+                putchar('\n');
+                i++;
+            }
+            else if(s[i+1] == 't'){
+                putchar('\t');
+                i++;
+            }
+            else if(s[i+1] == '"'){
+                putchar('"');
+                i++;
+            }
+            else
+                putchar('\\');
+        }
+        else
+            putchar(s[i]);
+        i++;
+    }
+}
+
+static void printLiteral(Literal result){
+    switch(result.type){
+        case LIT_NULL:
+            printf("Null");
+            break;
+        case LIT_LOGICAL:
+            printf("%s", result.lVal == 0 ? "False" : "True");
+            break;
+        case LIT_DOUBLE:
+            printf("%g", result.dVal);
+            break;
+        case LIT_INT:
+            printf("%ld", result.iVal);
+            break;
+        case LIT_STRING:
+            printString(result.sVal);
+            break;
+    }
+}
+
+void printObject(Object o){
+    switch(o.type){
+        case OBJECT_ARRAY:
+            printf("<array of %d>", o.arr.count);
+            break;
+        case OBJECT_CONTAINER:
+            printf("<container %s>", o.container->name);
+            break;
+        case OBJECT_INSTANCE:
+            printf("<instance of container %s>", o.instance->name);
+            break;
+        case OBJECT_ROUTINE:
+            printf("<routine %s>", o.routine->name);
+            break;
+        case OBJECT_NULL:
+            printf("Null");
+            break;
+        case OBJECT_LITERAL:
+            printLiteral(o.literal);
+            break;
+        case OBJECT_UNDEFINED: // never read, see slot_get
+            break;
+    }
+}
@@ -0,0 +1,42 @@
+#ifndef RUNTIME_H
+#define RUNTIME_H
+
+#include "scanner.h"
+#include "interpreter.h"
+#include "environment.h"
+#include "str.h"
+
+// Value semantics shared by the tree-walker and the bytecode VM
+
+#define EPSILON 0.0000000000000000000000001
+
+Object fromLiteral(Literal l);
+Literal toLiteral(Object o, int line);
+int isTruthy(Object o, int line);
+
+long intPower(long base, long exponent);
+Object binaryOp(Literal left, Literal right, TokenType op, int line);
+Object logicalOp(Object left, Object right, TokenType op, int line);
+
+Object readIndex(Object *target, char *identifer, Literal index, int line);
+void writeIndex(Object *target, char *identifer, Literal index, Object value, int line);
+void checkIndex(Literal index, int line);
+// Set identifer = identifer + value, strings are grown in place when the
+// target is their only holder
+void appendTo(Object *target, char *identifer, Object value, int line);
+
+// A string read from a named variable may still be held when a call
+// appends to that variable, so later appends copy it
+static inline Object readNamed(Object o){
+    if(o.type == OBJECT_LITERAL && o.literal.type == LIT_STRING)
+        str_header(o.literal.sVal)->shared = 1;
+    return o;
+}
+
+Object newInstance(char *name, Environment *env);
+void discardResult(Object o, int line);
+
+void printString(const char *s);
+void printObject(Object o);
+
+#endif
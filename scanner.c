@@ -5,6 +5,7 @@
 #include "scanner.h"
 #include "display.h"
 #include "allocator.h"
+#include "arena.h"
 
 typedef struct {
     const char* name;
@@ -68,6 +69,7 @@ typedef struct {
 
 static Scanner scanner;
 static int se = 0;
+static Arena tokens = {NULL};
 
 void initScanner(const char* source) {
     scanner.source = source;
@@ -265,7 +267,7 @@ static Token scanToken() {
 }
 
 static TokenList *newList(Token t){ 
-    TokenList *now = (TokenList *)mallocate(sizeof(TokenList));
+    TokenList *now = (TokenList *)arena_alloc(&tokens, sizeof(TokenList));
     now->value = t;
     now->next = NULL;
     return now;
@@ -310,12 +312,9 @@ void printList(TokenList *list){
     printf("TOKEN_EOF\n");
 }
 
-void freeList(TokenList *list){
-    while(list != NULL){
-        TokenList *bak = list->next;
-        memfree(list);
-        list = bak;
-    }
+// The nodes all live in one arena
+void freeList(){
+    arena_free(&tokens);
 }
 
 int hasScanErrors(){
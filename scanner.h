@@ -182,7 +182,7 @@ void initScanner(const char* source);
 
 TokenList* scanTokens();
 void printList(TokenList *list);
-void freeList(TokenList *list);
+void freeList();
 
 int hasScanErrors();
 
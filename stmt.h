@@ -66,6 +66,7 @@ typedef struct{
 typedef struct{
     Expression *identifer;
     Expression *initializerExpression;
+    int append; // the operands are appended to the target, see optimizer.c
 } Initializer;
 
 typedef struct{
@@ -74,16 +75,41 @@ typedef struct{
     Initializer *initializers;
 } Set;
 
+// Tested once on entry to a While counting counter up to bound, see
+// optimizer.c. Each array must hold the indices counter + low and
+// bound + high for its marked accesses to go unchecked.
+typedef struct{
+    int slot;
+    int low;
+    int high;
+} GuardedArray;
+
+typedef struct{
+    Expression *counter;
+    Expression *bound;
+    int count;
+    GuardedArray *arrays;
+} BoundsGuard;
+
 typedef struct{
     int line;
     Expression* condition;
     Block body;
+    BoundsGuard *guard; // NULL unless set by the optimizer
 } While;
 
+// Arrays declared :Int or :Float store packed elements
+typedef enum{
+    ARRAY_ANY,
+    ARRAY_INT,
+    ARRAY_FLOAT
+} ArrayDataType;
+
 typedef struct{
     int line;
     int count;
     Expression** initializers;
+    ArrayDataType *datatypes;
 } ArrayInit;
 
 typedef enum{
@@ -104,6 +130,7 @@ typedef struct{
         struct{
             InputDataType datatype;
             char *identifer;
+            int slot;
         };
     };
 } Input;
@@ -114,21 +141,30 @@ typedef struct{
     Input *inputs;
 } InputStatement;
 
-typedef struct{
+struct Chunk;
+
+typedef struct Routine{
     int line;
     char *name;
     int arity;
     char **arguments;
     short isNative;
     Block code;
+    int localCount; // arguments followed by locals, in slot order
+    char **locals;
+    struct Chunk *chunk;
+    void *foreign; // the symbol a foreign routine is bound to, see native.c
+    int binding;
+    int signature; // 0 for the (line, env) convention
 } Routine;
 
-typedef struct{
+typedef struct Container{
     int line;
     char *name;
     int arity;
     char **arguments;
     Block constructor;
+    struct Chunk *chunk;
 } Container;
 
 typedef struct{
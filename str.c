@@ -0,0 +1,57 @@
+#include <string.h>
+
+#include "str.h"
+
+// FNV-1a, never 0 so that 0 can mean not computed yet
+unsigned int str_hash_n(const char *chars, size_t length){
+    unsigned int hash = 2166136261u;
+    size_t i = 0;
+    while(i < length){
+        hash ^= (unsigned char)chars[i];
+        hash *= 16777619;
+        i++;
+    }
+    return hash == 0 ? 1 : hash;
+}
+
+unsigned int str_hash(const char *s){
+    String *h = str_header(s);
+    if(h->hash == 0)
+        h->hash = str_hash_n(s, h->length);
+    return h->hash;
+}
+
+int str_equal(const char *a, const char *b){
+    if(a == b)
+        return 1;
+    if(str_length(a) != str_length(b) || str_hash(a) != str_hash(b))
+        return 0;
+    return memcmp(a, b, str_length(a)) == 0;
+}
+
+typedef struct{
+    String header;
+    char chars[sizeof(String)];
+} CharString;
+
+static CharString chars[256];
+
+char* str_char(char c){
+    CharString *cs = &chars[(unsigned char)c];
+    if(cs->header.length == 0){
+        cs->chars[0] = c;
+        cs->header.length = 1;
+    }
+    return cs->chars;
+}
+
+char* str_init(void *mem, size_t length, int heap){
+    String *h = (String *)mem;
+    char *s = (char *)(h + 1);
+    h->hash = 0;
+    h->length = length;
+    h->heap = heap;
+    h->shared = 0;
+    s[length] = '\0';
+    return s;
+}
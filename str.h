@@ -0,0 +1,37 @@
+#ifndef STR_H
+#define STR_H
+
+#include <stddef.h>
+
+// Every string value, interned or collected, has this header right
+// before its characters. sVal keeps pointing at the characters, so
+// natives still see plain C strings.
+typedef struct{
+    unsigned int hash;          // 0 until first needed
+    unsigned int length : 30;
+    unsigned int heap : 1;      // owned by the collector, else a symbol
+    unsigned int shared : 1;    // stored in more than one place
+} String;
+
+#define STR_MAX_LENGTH ((1u << 30) - 1) // longest length that fits
+
+static inline String* str_header(const char *s){
+    return (String *)s - 1;
+}
+
+static inline size_t str_length(const char *s){
+    return str_header(s)->length;
+}
+
+unsigned int str_hash_n(const char *chars, size_t length);
+unsigned int str_hash(const char *s); // cached in the header
+int str_equal(const char *a, const char *b);
+
+// One character strings, made once and never collected. Their heap
+// bit is clear, so writes to them copy like writes to symbols.
+char* str_char(char c);
+
+// Writes the header at mem and returns where the characters go
+char* str_init(void *mem, size_t length, int heap);
+
+#endif
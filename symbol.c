@@ -0,0 +1,55 @@
+#include <string.h>
+
+#include "allocator.h"
+#include "arena.h"
+#include "symbol.h"
+#include "str.h"
+
+static Arena strings = {NULL};
+static char **table = NULL;
+static int count = 0, capacity = 0;
+
+static int find(const char *name, int length, unsigned int hash){
+    int mask = capacity - 1, i = hash & mask;
+    while(table[i] != NULL){
+        String *h = str_header(table[i]);
+        if(h->hash == hash && h->length == (unsigned int)length && memcmp(table[i], name, length) == 0)
+            return i;
+        i = (i + 1) & mask;
+    }
+    return i;
+}
+
+static void grow(){
+    char **old = table;
+    int oldCapacity = capacity, i = 0;
+    capacity = capacity == 0 ? 256 : capacity * 2;
+    table = (char **)mallocate(sizeof(char *) * capacity);
+    memset(table, 0, sizeof(char *) * capacity);
+    while(i < oldCapacity){
+        if(old[i] != NULL)
+            table[find(old[i], str_length(old[i]), str_hash(old[i]))] = old[i];
+        i++;
+    }
+    memfree(old);
+}
+
+// Symbols carry a string header too, with the hash filled in
+char* intern_n(const char *name, int length){
+    if((count + 1) * 4 > capacity * 3)
+        grow();
+    unsigned int hash = str_hash_n(name, length);
+    int i = find(name, length, hash);
+    if(table[i] == NULL){
+        char *s = str_init(arena_alloc(&strings, sizeof(String) + sizeof(char) * (length + 1)), length, 0);
+        memcpy(s, name, length);
+        str_header(s)->hash = hash;
+        table[i] = s;
+        count++;
+    }
+    return table[i];
+}
+
+char* intern(const char *name){
+    return intern_n(name, strlen(name));
+}
@@ -0,0 +1,10 @@
+#ifndef SYMBOL_H
+#define SYMBOL_H
+
+// Interned identifiers and string literals : equal names share one
+// pointer, so lookups compare pointers. Symbols are never freed and
+// must not be written to.
+char* intern(const char *name);
+char* intern_n(const char *name, int length);
+
+#endif
@@ -0,0 +1,609 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "display.h"
+#include "allocator.h"
+#include "io.h"
+#include "native.h"
+#include "runtime.h"
+#include "vm.h"
+#include "symbol.h"
+#include "gc.h"
+
+#define FRAMES_MAX 16384
+#define STACK_MAX (FRAMES_MAX * 16)
+#define SCOPES_MAX 1024
+
+typedef enum{
+    FRAME_SCRIPT,
+    FRAME_ROUTINE,
+    FRAME_CONTAINER
+} FrameType;
+
+typedef struct{
+    FrameType type;
+    Chunk *chunk;
+    unsigned char *ip;
+    Object *base;
+    Environment *env;
+    char *name;
+} CallFrame;
+
+Object undefinedObject = {.literal = {.type = LIT_NULL}, .type = OBJECT_UNDEFINED};
+
+static CallFrame frames[FRAMES_MAX];
+static int frameCount = 0;
+
+static Object stack[STACK_MAX];
+static Object *top = stack;
+
+// Environments shadowed by member evaluation (OP_ENTER), and the
+// instances entered, which are no longer on the stack
+static Environment *scopes[SCOPES_MAX];
+static Instance *entered[SCOPES_MAX];
+static int scopeCount = 0;
+
+static Environment *globalEnv = NULL;
+static char *mainSymbol = NULL;
+
+#define push(x) (*top++ = (x))
+#define pop() (*--top)
+
+void vm_init(Environment *global){
+    globalEnv = global;
+    mainSymbol = intern("Main");
+    frameCount = 0;
+    scopeCount = 0;
+    top = stack;
+}
+
+static void pushFrame(FrameType type, Chunk *chunk, Object *base, Environment *env, char *name, int line){
+    if(frameCount == FRAMES_MAX || top - stack > STACK_MAX - 512){
+        printf(runtime_error("Stack overflow while calling %s!"), line, name);
+        stop();
+    }
+    CallFrame *frame = &frames[frameCount++];
+    frame->type = type;
+    frame->chunk = chunk;
+    frame->ip = chunk->code;
+    frame->base = base;
+    frame->env = env;
+    frame->name = name;
+}
+
+static Environment* bindArguments(Environment *env, char **arguments, int arity, int line){
+    Object *args = top - arity;
+    int i = 0;
+    while(i < arity){
+        env_put(arguments[i], line, args[i], env);
+        i++;
+    }
+    return env;
+}
+
+// Arguments already sit on the stack in their slots, the remaining locals follow them
+static void bindSlots(Routine *r, int line){
+    Object *args = top - r->arity;
+    int i = 0;
+    while(i < r->arity){
+        Object value = args[i];
+        args[i] = undefinedObject;
+        slot_put(&args[i], r->locals[i], line, value);
+        i++;
+    }
+    while(i < r->localCount){
+        push(undefinedObject);
+        i++;
+    }
+}
+
+// Typed routines take their arguments straight off the stack
+static void invokeForeign(Routine *r, int line){
+    Object obj;
+    if(native_typed(r, line))
+        obj = call_typed(r, top - r->arity, line);
+    else{
+        Environment *routineEnv = bindArguments(env_push(globalEnv, r->name, line), r->arguments, r->arity, line);
+        obj = handle_native(r, line, routineEnv);
+        env_pop(routineEnv);
+    }
+    top -= r->arity;
+    push(obj);
+}
+
+static void invokeRoutine(Routine *r, int line){
+    if(r->isNative == 1){
+        invokeForeign(r, line);
+        return;
+    }
+    pushFrame(FRAME_ROUTINE, r->chunk, top - r->arity, globalEnv, r->name, line);
+    bindSlots(r, line);
+}
+
+static void invokeContainer(Container *c, int line){
+    Environment *containerEnv = bindArguments(env_new(globalEnv), c->arguments, c->arity, line);
+    pushFrame(FRAME_CONTAINER, c->chunk, top - c->arity, containerEnv, c->name, line);
+}
+
+static void callRoutine(char *name, int argc, int line){
+    Routine *r = env_routine_get(name, line, globalEnv);
+    if(r->arity != argc){
+        printf(runtime_error("Argument count mismatch for routine %s! Expected : %d Received %d!"),
+                line, name, r->arity, argc);
+        stop();
+    }
+    invokeRoutine(r, line);
+}
+
+static void callContainer(char *name, int argc, int line){
+    Container *c = env_container_get(name, line, globalEnv);
+    if(c->arity != argc){
+        printf(runtime_error("Argument count mismatch for container %s! Expected : %d Received %d!"),
+                line, name, c->arity, argc);
+        stop();
+    }
+    invokeContainer(c, line);
+}
+
+static void callValue(char *name, int argc, int line, Environment *env){
+    if(name != mainSymbol){
+        Object callee = env_get(name, line, env);
+        if(callee.type != OBJECT_ROUTINE){
+            callContainer(name, argc, line);
+            return;
+        }
+    }
+    callRoutine(name, argc, line);
+}
+
+static Instance* toInstance(Object o, const char *message, int line){
+    if(o.type != OBJECT_INSTANCE){
+        printf(runtime_error("%s"), line, message);
+        stop();
+    }
+    return o.instance;
+}
+
+#define READ_BYTE() (*frame->ip++)
+#define READ_SHORT() (frame->ip += 2, (unsigned short)((frame->ip[-2] << 8) | frame->ip[-1]))
+#define READ_NAME() (frame->chunk->names[READ_SHORT()])
+#define READ_CACHE() (&frame->chunk->caches[READ_SHORT()])
+#define READ_CALLEE() (frame->chunk->callees[READ_SHORT()])
+#define LINE() (frame->chunk->lines[frame->ip - frame->chunk->code - 1])
+
+#define isInt(o) ((o).type == OBJECT_LITERAL && (o).literal.type == LIT_INT)
+
+#define ARITHMETIC(op, token) \
+    do{ \
+        Object *b = top - 1, *a = top - 2; \
+        if(isInt(*a) && isInt(*b)) \
+            a->literal.iVal = a->literal.iVal op b->literal.iVal; \
+        else \
+            *a = binaryOp(toLiteral(*a, LINE()), toLiteral(*b, LINE()), token, LINE()); \
+        top--; \
+    } while(0)
+
+// Compared as doubles, like the generic path
+#define COMPARISON(op, token) \
+    do{ \
+        Object *b = top - 1, *a = top - 2; \
+        if(isInt(*a) && isInt(*b)){ \
+            int r = (double)a->literal.iVal op (double)b->literal.iVal; \
+            a->literal.type = LIT_LOGICAL; \
+            a->literal.lVal = r; \
+        } \
+        else \
+            *a = logicalOp(*a, *b, token, LINE()); \
+        top--; \
+    } while(0)
+
+static Object run(int exitDepth){
+    CallFrame *frame = &frames[frameCount - 1];
+    while(1){
+        switch(READ_BYTE()){
+            case OP_CONSTANT:
+                push(frame->chunk->constants[READ_SHORT()]);
+                break;
+            case OP_NULL:
+                push(nullObject);
+                break;
+            case OP_POP:
+                top--;
+                break;
+            case OP_GET_VAR:
+                {
+                    char *name = READ_NAME();
+                    push(readNamed(env_get(name, LINE(), frame->env)));
+                }
+                break;
+            case OP_SET_VAR:
+                {
+                    char *name = READ_NAME();
+                    Object value = pop();
+                    env_put(name, LINE(), value, frame->env);
+                }
+                break;
+            case OP_GET_INDEX:
+                {
+                    char *name = READ_NAME();
+                    Object index = pop();
+                    push(readIndex(env_lookup(name, frame->env), name, toLiteral(index, LINE()), LINE()));
+                }
+                break;
+            case OP_SET_INDEX:
+                {
+                    char *name = READ_NAME();
+                    Object value = pop();
+                    Object index = pop();
+                    writeIndex(env_lookup(name, frame->env), name, toLiteral(index, LINE()), value, LINE());
+                }
+                break;
+            case OP_GET_LOCAL:
+                {
+                    int slot = READ_BYTE();
+                    push(slot_get(&frame->base[slot], frame->chunk->locals[slot], LINE()));
+                }
+                break;
+            case OP_SET_LOCAL:
+                {
+                    int slot = READ_BYTE();
+                    Object value = pop();
+                    slot_put(&frame->base[slot], frame->chunk->locals[slot], LINE(), value);
+                }
+                break;
+            case OP_GET_LOCAL_INDEX:
+                {
+                    int slot = READ_BYTE();
+                    Object index = pop();
+                    push(readIndex(&frame->base[slot], frame->chunk->locals[slot], toLiteral(index, LINE()), LINE()));
+                }
+                break;
+            case OP_SET_LOCAL_INDEX:
+                {
+                    int slot = READ_BYTE();
+                    Object value = pop();
+                    Object index = pop();
+                    writeIndex(&frame->base[slot], frame->chunk->locals[slot], toLiteral(index, LINE()), value, LINE());
+                }
+                break;
+            case OP_GET_LOCAL_ELEMENT:
+                {
+                    int slot = READ_BYTE();
+                    Object index = pop();
+                    push(arr_get(&frame->base[slot].arr, index.literal.iVal));
+                }
+                break;
+            case OP_SET_LOCAL_ELEMENT:
+                {
+                    int slot = READ_BYTE();
+                    Object value = pop();
+                    Object index = pop();
+                    arr_put(&frame->base[slot].arr, frame->chunk->locals[slot], LINE(), index.literal.iVal, value);
+                }
+                break;
+            case OP_APPEND_VAR:
+                {
+                    char *name = READ_NAME();
+                    Object value = pop();
+                    appendTo(env_lookup(name, frame->env), name, value, LINE());
+                }
+                break;
+            case OP_APPEND_LOCAL:
+                {
+                    int slot = READ_BYTE();
+                    Object *target = &frame->base[slot];
+                    top--;
+                    if(isInt(*target) && isInt(*top))
+                        target->literal.iVal += top->literal.iVal;
+                    else
+                        appendTo(target, frame->chunk->locals[slot], *top, LINE());
+                }
+                break;
+            case OP_GET_MEMBER:
+                {
+                    char *name = READ_NAME();
+                    MemberCache *cache = READ_CACHE();
+                    Instance *ins = toInstance(pop(), "Invalid member reference!", LINE());
+                    Object *member = env_member(name, ins->name, cache, (Environment *)ins->environment);
+                    push(member != NULL ? *member : env_get(name, LINE(), (Environment *)ins->environment));
+                }
+                break;
+            case OP_SET_MEMBER:
+                {
+                    char *name = READ_NAME();
+                    MemberCache *cache = READ_CACHE();
+                    Object value = pop();
+                    Instance *ins = toInstance(pop(), "Referenced item is not an instance of a container!", LINE());
+                    Object *member = env_member(name, ins->name, cache, (Environment *)ins->environment);
+                    if(member != NULL)
+                        slot_put(member, name, LINE(), value);
+                    else
+                        env_put(name, LINE(), value, (Environment *)ins->environment);
+                }
+                break;
+            case OP_SET_MEMBER_INDEX:
+                {
+                    char *name = READ_NAME();
+                    MemberCache *cache = READ_CACHE();
+                    Object value = pop();
+                    Object index = pop();
+                    Instance *ins = toInstance(pop(), "Referenced item is not an instance of a container!", LINE());
+                    Object *member = env_member(name, ins->name, cache, (Environment *)ins->environment);
+                    if(member == NULL)
+                        member = env_lookup(name, (Environment *)ins->environment);
+                    writeIndex(member, name, toLiteral(index, LINE()), value, LINE());
+                }
+                break;
+            case OP_ENTER:
+                {
+                    Instance *ins = toInstance(pop(), "Invalid member reference!", LINE());
+                    if(scopeCount == SCOPES_MAX){
+                        printf(runtime_error("Member references nested too deeply!"), LINE());
+                        stop();
+                    }
+                    entered[scopeCount] = ins;
+                    scopes[scopeCount++] = frame->env;
+                    frame->env = (Environment *)ins->environment;
+                }
+                break;
+            case OP_LEAVE:
+                frame->env = scopes[--scopeCount];
+                break;
+            case OP_ADD:
+                ARITHMETIC(+, TOKEN_PLUS);
+                break;
+            case OP_SUBTRACT:
+                ARITHMETIC(-, TOKEN_MINUS);
+                break;
+            case OP_MULTIPLY:
+                ARITHMETIC(*, TOKEN_STAR);
+                break;
+            case OP_DIVIDE:
+                ARITHMETIC(/, TOKEN_SLASH);
+                break;
+            case OP_MODULO:
+                ARITHMETIC(%, TOKEN_PERCEN);
+                break;
+            case OP_POWER:
+                top[-2] = binaryOp(toLiteral(top[-2], LINE()), toLiteral(top[-1], LINE()), TOKEN_CARET, LINE());
+                top--;
+                break;
+            case OP_GREATER:
+                COMPARISON(>, TOKEN_GREATER);
+                break;
+            case OP_GREATER_EQUAL:
+                COMPARISON(>=, TOKEN_GREATER_EQUAL);
+                break;
+            case OP_LESS:
+                COMPARISON(<, TOKEN_LESS);
+                break;
+            case OP_LESS_EQUAL:
+                COMPARISON(<=, TOKEN_LESS_EQUAL);
+                break;
+            case OP_EQUAL:
+                COMPARISON(==, TOKEN_EQUAL_EQUAL);
+                break;
+            case OP_NOT_EQUAL:
+                COMPARISON(!=, TOKEN_BANG_EQUAL);
+                break;
+            case OP_AND:
+                top[-2] = logicalOp(top[-2], top[-1], TOKEN_AND, LINE());
+                top--;
+                break;
+            case OP_OR:
+                top[-2] = logicalOp(top[-2], top[-1], TOKEN_OR, LINE());
+                top--;
+                break;
+            case OP_JUMP:
+                {
+                    unsigned short offset = READ_SHORT();
+                    frame->ip += offset;
+                }
+                break;
+            case OP_JUMP_IF_FALSE:
+                {
+                    unsigned short offset = READ_SHORT();
+                    if(!isTruthy(pop(), LINE()))
+                        frame->ip += offset;
+                }
+                break;
+            case OP_CHECK_BOUNDS:
+                {
+                    int count = READ_BYTE();
+                    Object bound = pop();
+                    Object counter = pop();
+                    int inRange = isInt(counter) && isInt(bound);
+                    while(count-- > 0){
+                        Object *arr = &frame->base[READ_BYTE()];
+                        short low = READ_SHORT();
+                        short high = READ_SHORT();
+                        inRange = inRange && arr->type == OBJECT_ARRAY && counter.literal.iVal >= 1 - low
+                            && bound.literal.iVal <= arr->arr.count - high;
+                    }
+                    unsigned short offset = READ_SHORT();
+                    if(!inRange)
+                        frame->ip += offset;
+                }
+                break;
+            case OP_LOOP:
+                {
+                    unsigned short offset = READ_SHORT();
+                    frame->ip -= offset;
+                    gc_safepoint();
+                }
+                break;
+            case OP_CALL:
+                {
+                    char *name = READ_NAME();
+                    int argc = READ_BYTE();
+                    callValue(name, argc, LINE(), frame->env);
+                    frame = &frames[frameCount - 1];
+                    gc_safepoint();
+                }
+                break;
+            case OP_CALL_ROUTINE:
+                {
+                    Routine *r = (Routine *)READ_CALLEE();
+                    frame->ip++; // argc, checked by the linker
+                    invokeRoutine(r, LINE());
+                    frame = &frames[frameCount - 1];
+                    gc_safepoint();
+                }
+                break;
+            case OP_CALL_CONTAINER:
+                {
+                    Container *c = (Container *)READ_CALLEE();
+                    frame->ip++;
+                    invokeContainer(c, LINE());
+                    frame = &frames[frameCount - 1];
+                    gc_safepoint();
+                }
+                break;
+            case OP_CALL_FOREIGN:
+                {
+                    Routine *r = (Routine *)READ_CALLEE();
+                    frame->ip++;
+                    invokeForeign(r, LINE());
+                }
+                break;
+            case OP_DISCARD:
+                discardResult(pop(), LINE());
+                break;
+            case OP_RETURN:
+                {
+                    Object result = pop();
+                    frameCount--;
+                    if(frame->type == FRAME_CONTAINER)
+                        result = newInstance(frame->name, frame->env);
+                    top = frame->base;
+                    if(frameCount == exitDepth)
+                        return result;
+                    push(result);
+                    frame = &frames[frameCount - 1];
+                }
+                break;
+            case OP_PRINT:
+                printObject(pop());
+                break;
+            case OP_INPUT:
+            case OP_LOCAL_INPUT:
+                {
+                    Object *slot = NULL;
+                    char *name;
+                    if(frame->ip[-1] == OP_INPUT)
+                        name = READ_NAME();
+                    else{
+                        int index = READ_BYTE();
+                        slot = &frame->base[index];
+                        name = frame->chunk->locals[index];
+                    }
+                    InputDataType type = (InputDataType)READ_BYTE();
+                    int line = LINE();
+                    Literal l;
+                    switch(type){
+                        case INPUT_ANY:
+                            l = getString();
+                            break;
+                        case INPUT_FLOAT:
+                            l = getFloat();
+                            break;
+                        case INPUT_INT:
+                        default:
+                            l = getInt();
+                            break;
+                    }
+                    if(slot == NULL)
+                        env_put(name, line, fromLiteral(l), frame->env);
+                    else
+                        slot_put(slot, name, line, fromLiteral(l));
+                }
+                break;
+            case OP_ARRAY:
+            case OP_LOCAL_ARRAY:
+                {
+                    Object *slot = NULL;
+                    char *name;
+                    if(frame->ip[-1] == OP_ARRAY)
+                        name = READ_NAME();
+                    else{
+                        int index = READ_BYTE();
+                        slot = &frame->base[index];
+                        name = frame->chunk->locals[index];
+                    }
+                    ArrayDataType datatype = (ArrayDataType)READ_BYTE();
+                    Literal dim = toLiteral(pop(), LINE());
+                    if(dim.type != LIT_INT){
+                        printf(runtime_error("Array dimension must be an integer!"), LINE());
+                        stop();
+                    }
+                    if(slot == NULL)
+                        env_arr_new(name, LINE(), dim.iVal, datatype, frame->env);
+                    else
+                        slot_arr_new(slot, name, LINE(), dim.iVal, datatype);
+                }
+                break;
+            case OP_DEFINE:
+                {
+                    Object o = frame->chunk->constants[READ_SHORT()];
+                    if(o.type == OBJECT_ROUTINE)
+                        env_routine_put(o.routine, o.routine->line, globalEnv);
+                    else
+                        env_container_put(o.container, o.container->line, globalEnv);
+                }
+                break;
+            case OP_END:
+                memfree_all();
+                exit(0);
+                break;
+        }
+    }
+}
+
+// The global environment, which most frames run in, is marked by the
+// collector itself
+void vm_mark_roots(){
+    Object *o = stack, ins = {.type = OBJECT_INSTANCE};
+    int i = 0;
+    while(o < top){
+        gc_mark(*o);
+        o++;
+    }
+    while(i < frameCount){
+        if(frames[i].env != globalEnv)
+            gc_mark_env(frames[i].env);
+        i++;
+    }
+    i = 0;
+    while(i < scopeCount){
+        if(scopes[i] != globalEnv)
+            gc_mark_env(scopes[i]);
+        ins.instance = entered[i];
+        gc_mark(ins);
+        i++;
+    }
+}
+
+Object vm_execute(Chunk *script){
+    pushFrame(FRAME_SCRIPT, script, top, globalEnv, "<script>", 0);
+    return run(frameCount - 1);
+}
+
+Object vm_call(Routine *r, Object *args, int line){
+    int depth = frameCount, i = 0;
+    while(i < r->arity){
+        push(args[i]);
+        i++;
+    }
+    invokeRoutine(r, line);
+    if(frameCount == depth)
+        return pop();
+    return run(depth);
+}
+
+Object vm_call_main(){
+    int depth = frameCount;
+    callValue(mainSymbol, 0, 0, globalEnv);
+    if(frameCount == depth)
+        return pop();
+    return run(depth);
+}
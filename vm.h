@@ -0,0 +1,15 @@
+#ifndef VM_H
+#define VM_H
+
+#include "chunk.h"
+#include "environment.h"
+
+void vm_init(Environment *global);
+Object vm_execute(Chunk *script);
+Object vm_call_main();
+// Runs r to completion from inside a native
+Object vm_call(Routine *r, Object *args, int line);
+// Marks the values on the stack and the environments of the frames
+void vm_mark_roots();
+
+#endif